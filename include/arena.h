@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+Bump allocator for everything a compilation creates: tokens, token text,
+ast nodes and diagnostics. Nothing is freed individually; arena_reset()
+releases all allocations at once but keeps the first block for reuse.
+
+Functions taking an arena accept NULL and fall back to the heap.
+*/
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+} arena_block;
+
+typedef struct arena {
+    arena_block *head;
+    size_t block_size;
+} arena;
+
+arena *init_arena(size_t block_size);
+void free_arena(arena *mem);
+void arena_reset(arena *mem);
+void *arena_alloc(arena *mem, size_t size);
+char *arena_strndup(arena *mem, const char *s, size_t len);
+
+#endif
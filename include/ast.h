@@ -1,7 +1,10 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdio.h>
+
 #include "token.h"
+#include "arena.h"
 
 
 
@@ -19,7 +22,9 @@ enum node_type
     END_STATEMENT,
     INPUT_STATEMENT,
     EXPRESSION,
-    STRING_LITERAL
+    STRING_LITERAL,
+    PRINT_SEPARATOR,
+    USR_CALL
 };
 typedef struct ast {
     struct ast* child;
@@ -28,12 +33,14 @@ typedef struct ast {
     enum node_type type;
 }ast;
 
-ast* init_node(enum node_type type, token* tok);
+ast* init_node(arena* mem, enum node_type type, token* tok);
 
 void ast_add_child(ast* parent, ast* child);
 
 const char* node_type_to_string(enum node_type type);
 
+void fprint_ast(FILE* out, ast* node, int indent);
+
 void print_ast(ast* node, int indent);
 
 
@@ -0,0 +1,94 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ir.h"
+#include "vm.h"
+#include "rtio.h"
+
+/*
+Batch execution: one program run over many input sets at once.
+
+Every input set is a lane. Lanes are grouped in blocks of BATCH_WIDTH, and
+a block keeps each variable and temp as one row of BATCH_WIDTH int16_t, so
+an IR instruction on a row is a single AVX2 operation on 16 lanes. The
+AVX2 kernels are picked at run time, with a scalar fallback.
+
+A warp is a set of lanes of one block that share a pc and a GOSUB stack.
+A conditional jump that only some lanes take splits the warp in two, and
+a computed GOTO or GOSUB splits it by target line. The most deeply
+nested warp with the lowest pc runs first and stops where another warp
+is waiting, so warps that reach the same pc with the same stack merge
+again.
+
+| Instructions     | How they run                                   |
+| ---------------- | ---------------------------------------------- |
+| MOV..NE but DIV  | vector kernel under the warp's lane mask       |
+| jumps and loops  | vector compare, lane mask of taken branches    |
+| DIV              | scalar, a zero divisor fails only that lane    |
+| PRINT, INPUT     | the lane's own output buffer and input set     |
+| USR              | the lane's own memory pages                    |
+
+A failing lane stops alone; the rest of its warp goes on. Output is held
+until the batch ends, so a lane that prints more than BATCH_OUTPUT_LIMIT
+bytes fails with "output limit", and a lane that runs more than budget
+instructions fails with "budget exceeded" instead of holding up the
+batch. A warp counts its steps once for all its lanes and adds them to
+each lane when it merges or jumps; the budget is checked at jumps.
+*/
+
+#define BATCH_WIDTH 16      // lanes per block: one AVX2 vector of int16_t
+#define BATCH_OUTPUT_CAP 64 // initial per-lane output buffer, grows
+#define BATCH_OUTPUT_LIMIT (16 * RT_OUTPUT_CAP) // a lane printing more fails
+#define BATCH_DEFAULT_BUDGET 10000000L // instructions per lane
+
+typedef struct batch_warp {
+    int pc;
+    uint16_t mask;      // lanes of the block in this warp
+    int sp;
+    int stack[VM_STACK_DEPTH];
+    long steps;         // run by every lane, not yet added to the lanes
+    long base;          // most steps any of its lanes had before those
+} batch_warp;
+
+typedef struct batch_lane {
+    rt_input *in;
+    rt_output *out;
+    uint8_t **pages;    // VM_NPAGES pointers, allocated on first POKE
+    int16_t usr_arg;
+    long steps;         // instructions run
+    enum vm_status status;
+    const char *error;
+    int error_line;
+} batch_lane;
+
+typedef struct batch {
+    ir_program *ir;
+    int nlanes;
+    int nblocks;
+    int nslots;         // variables, then temps: one row each
+    int16_t *regs;      // [block][slot][BATCH_WIDTH]
+    int16_t *consts;    // [pc][a, b][BATCH_WIDTH]: constant operands
+    batch_lane *lanes;
+    int cold_start;
+    long budget;        // instructions a lane may run
+    int simd;           // use the AVX2 kernels; cleared if the CPU lacks AVX2
+
+    // warps of the block being run
+    batch_warp warps[BATCH_WIDTH];
+    int nwarps;
+
+    uint64_t warp_steps;
+    uint64_t lane_steps;
+    uint64_t splits;
+    uint64_t merges;
+} batch;
+
+batch *init_batch(ir_program *ir, rt_input **inputs, int nlanes);
+void free_batch(batch *b);
+void batch_run(batch *b);
+void fprint_batch_stats(FILE *out, batch *b);
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+
+#include "ast.h"
+
+/*
+Linear three-address IR.
+
+The program is lowered from the ast into a flat array of instructions of the
+form `dst = a op b`. Control flow uses instruction indices as targets, and the
+line table maps every BASIC line number onto the index of its first
+instruction so GOTO/GOSUB to computed line numbers can be resolved at run time.
+
+| Operand  | Printed as | Notes                                        |
+| -------- | ---------- | -------------------------------------------- |
+| const    | `42`       | 16-bit integer literal                       |
+| var      | `A`..`Z`   | value holds 0..25                            |
+| temp     | `t3`       | defined once and used inside its block; the  |
+|          |            | loop pass may hoist or step it across a loop |
+| string   | `"TEXT"`   | value indexes ir_program.strings             |
+*/
+
+enum ir_opcode
+{
+    IR_NOP,
+    IR_MOV,         // dst = a
+    IR_ADD,         // dst = a + b
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_LT,          // dst = a < b
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_EQ,
+    IR_NE,
+    IR_JMP,         // goto target
+    IR_JZ,          // if a == 0 goto target
+    IR_JNZ,         // if a != 0 goto target
+    IR_JLT,         // if a < b goto target (fused compare + branch)
+    IR_JLE,
+    IR_JGT,
+    IR_JGE,
+    IR_JEQ,
+    IR_JNE,
+    IR_LOOP_LT,     // dst = dst + a; if dst < b goto target (counted loop latch)
+    IR_LOOP_LE,
+    IR_LOOP_GT,
+    IR_LOOP_GE,
+    IR_LOOP_EQ,
+    IR_LOOP_NE,
+    IR_GOTO_LINE,   // goto line a (computed)
+    IR_GOSUB,       // push return, goto target
+    IR_GOSUB_LINE,  // push return, goto line a (computed)
+    IR_RETURN,
+    IR_END,
+    IR_PRINT,       // print a
+    IR_PRINT_TAB,   // advance to the next print zone
+    IR_PRINT_NL,
+    IR_INPUT,       // dst = value read from input
+    IR_USR_ARG,     // third USR argument for the IR_USR that follows
+    IR_USR          // dst = USR(a, b)
+};
+
+enum ir_operand_kind
+{
+    OPERAND_NONE,
+    OPERAND_CONST,
+    OPERAND_VAR,
+    OPERAND_TEMP,
+    OPERAND_STRING
+};
+
+typedef struct ir_operand {
+    enum ir_operand_kind kind;
+    int value;
+} ir_operand;
+
+typedef struct ir_instr {
+    enum ir_opcode op;
+    ir_operand dst;
+    ir_operand a;
+    ir_operand b;
+    int target;     // instruction index for static jumps, -1 if unresolved
+    int line;       // source line number the instruction was lowered from
+} ir_instr;
+
+typedef struct ir_line {
+    int line;
+    int index;
+} ir_line;
+
+// A loop transformed by ir_pass_loops, kept for the optimization report.
+typedef struct ir_loop {
+    int first_line;
+    int last_line;
+    int var;        // induction variable 0..25, -1 if none was found
+    int step;
+    int hoisted;    // invariant instructions moved to the preheader
+    int reduced;    // multiplications by the induction variable replaced
+    int counted;    // latch fused into an IR_LOOP_* instruction
+} ir_loop;
+
+typedef struct ir_program {
+    ir_instr *code;
+    int count;
+    int cap;
+
+    ir_line *lines;
+    int nlines;
+    int linecap;
+
+    char **strings;
+    int nstrings;
+    int strcap;
+
+    ir_loop *loops;
+    int nloops;
+    int loopcap;
+
+    int ntemps;
+    int has_dynamic_jumps;
+} ir_program;
+
+typedef int (*ir_pass_fn)(ir_program *ir);
+
+typedef struct ir_pass {
+    const char *name;
+    ir_pass_fn run;
+} ir_pass;
+
+ir_program *init_ir_program(void);
+void free_ir_program(ir_program *ir);
+
+ir_program *ir_lower(ast *prog);
+
+int ir_emit(ir_program *ir, enum ir_opcode op, ir_operand dst, ir_operand a, ir_operand b);
+int ir_line_slot(ir_program *ir, int line);
+int ir_find_line(ir_program *ir, int line);
+void ir_compact(ir_program *ir);
+
+int ir_pass_cse(ir_program *ir);
+int ir_pass_copy_propagation(ir_program *ir);
+int ir_pass_dead_stores(ir_program *ir);
+int ir_pass_peephole(ir_program *ir);
+int ir_pass_loops(ir_program *ir);
+
+int ir_run_passes(ir_program *ir, const ir_pass *passes, int npasses, FILE *report);
+int ir_optimize(ir_program *ir, FILE *report);
+
+const char *ir_opcode_to_string(enum ir_opcode op);
+void fprint_ir(FILE *out, ir_program *ir);
+void fprint_ir_loops(FILE *out, ir_program *ir);
+void print_ir(ir_program *ir);
+
+#endif
@@ -2,15 +2,23 @@
 #define LEX_H
 
 #include "token.h"
+#include "arena.h"
 
 typedef struct lexer{
     char* src;
     int pos;
     int line;
     int col;
+    arena* mem;
+
+    // one-token lookahead cache and the lexer position just past it
+    token* ahead;
+    int ahead_pos;
+    int ahead_line;
+    int ahead_col;
 }lexer;
 
-lexer* init_lexer(char* src);
+lexer* init_lexer(arena* mem, char* src);
 
 token* next_token(lexer* lex);
 
@@ -1,27 +1,71 @@
 #ifndef PARSE_H
 #define PARSE_H
 
-
+#include <setjmp.h>
 
 
 #include "lex.h"
 #include "ast.h"
 #include "token.h"
-ast* parse(lexer* lex);
-ast* parse_program(lexer* lex);
-ast* parse_line(lexer* lex);
-ast* parse_statement(lexer* lex);
-ast* parse_let(lexer* lex);
-ast* parse_print(lexer* lex);
-ast* parse_input(lexer* lex);
-ast* parse_goto(lexer* lex);
-ast* parse_if(lexer* lex);
-ast* parse_gosub(lexer* lex);
-ast* parse_return_stmt(lexer* lex);
-ast* parse_end_stmt(lexer* lex);
-ast* parse_rem_stmt(lexer* lex);
-ast* parse_expression(lexer* lex);
-ast* parse_term(lexer* lex);
-ast* parse_factor(lexer* lex);
-
-#endif
\ No newline at end of file
+#include "arena.h"
+
+/*
+Parse errors never abort the process. Each one is recorded as a diagnostic,
+the rest of the offending line is skipped up to TOKEN_EOL, and parsing
+resumes with the next line, so one pass reports every error in a file.
+Lines with errors are left out of the PROGRAM node. Line numbers must
+ascend, so a line numbered at or below the last kept line is an error.
+
+The expression parser recurses, and so does every pass over the tree it
+builds, so an expression may be at most PARSE_MAX_DEPTH levels deep;
+each parenthesis, sign, USR call and binary operator is one level.
+*/
+
+#define PARSE_MAX_DEPTH 256
+
+typedef struct diagnostic {
+    int line;           // source line and column of the offending token
+    int col;
+    int basic_line;     // BASIC line number being parsed, -1 if none yet
+    int expected;       // token type that was expected, -1 if not a single type
+    int got;            // token type found
+    char *got_value;
+    char *message;
+} diagnostic;
+
+typedef struct parser {
+    lexer *lex;
+    arena *mem;
+    int basic_line;
+    int last_line;      // number of the last line kept, -1 if none
+    int depth;          // expression levels open on the current line
+
+    diagnostic *diags;
+    int ndiags;
+    int diagcap;
+
+    jmp_buf recover;
+} parser;
+
+parser* init_parser(lexer* lex);
+void fprint_diagnostic(FILE* out, const char* filename, diagnostic* d);
+
+ast* parse(parser* p);
+ast* parse_program(parser* p);
+ast* parse_line(parser* p);
+ast* parse_statement(parser* p);
+ast* parse_let(parser* p);
+ast* parse_print(parser* p);
+ast* parse_input(parser* p);
+ast* parse_goto(parser* p);
+ast* parse_if(parser* p);
+ast* parse_gosub(parser* p);
+ast* parse_return_stmt(parser* p);
+ast* parse_end_stmt(parser* p);
+ast* parse_rem_stmt(parser* p);
+ast* parse_expression(parser* p);
+ast* parse_term(parser* p);
+ast* parse_factor(parser* p);
+ast* parse_usr(parser* p);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ir.h"
+
+/*
+Per-line execution profiler for the VM.
+
+Everything is kept per BASIC line, indexed like ir_program.lines. In
+PROFILE_COUNT mode every line entry is counted and the wall time between
+line changes is charged to the line that was running. In PROFILE_SAMPLE
+mode a SIGPROF timer only raises a flag; the VM records the current line
+at the next instruction, so nothing is touched from the signal handler.
+
+Both modes follow GOSUB/RETURN in a call tree whose nodes are subroutine
+entry lines, which is what the collapsed-stack output is built from:
+
+    main;GOSUB 500;LINE 510 1234
+
+A VM without a profile attached pays one predictable branch per
+instruction. Only one sampling profile can run at a time.
+*/
+
+#define PROFILE_DEFAULT_HZ 1000
+
+enum profile_mode
+{
+    PROFILE_COUNT,
+    PROFILE_SAMPLE
+};
+
+typedef struct profile_node {
+    int parent;
+    int slot;           // line entered by the GOSUB, -1 for the root
+    int child;
+    int sibling;
+    uint64_t *weight;   // per line, allocated on first charge
+} profile_node;
+
+typedef struct profile {
+    ir_program *ir;
+    enum profile_mode mode;
+    int hz;
+
+    int nslots;
+    int *slot;          // per instruction: index of its line
+    char *entry;        // per instruction: first instruction of its line
+
+    uint64_t *hits;     // per line: times entered
+    uint64_t *weight;   // per line: nanoseconds or samples
+    uint64_t *calls;    // per line: GOSUBs landing on it
+    uint64_t total;
+
+    profile_node *nodes;
+    int nnodes;
+    int nodecap;
+    int node;           // current call tree node
+
+    int cur;            // line being charged, -1 before the first step
+    uint64_t last;      // time of the last charge
+} profile;
+
+extern volatile sig_atomic_t profile_tick;
+
+profile *init_profile(ir_program *ir, enum profile_mode mode, int hz);
+void free_profile(profile *p);
+
+void profile_start(profile *p);
+void profile_stop(profile *p);
+void profile_restart(profile *p);
+
+void profile_switch(profile *p, int pc);
+void profile_sample(profile *p, int pc);
+void profile_call(profile *p, int target);
+void profile_return(profile *p, int pc);
+
+void fprint_profile_listing(FILE *out, profile *p, const char *src);
+void fprint_profile_stacks(FILE *out, profile *p);
+
+// Called by the VM before every instruction.
+static inline void profile_step(profile *p, int pc)
+{
+    if (p->mode == PROFILE_SAMPLE) {
+        if (profile_tick)
+            profile_sample(p, pc);
+        return;
+    }
+    if (p->entry[pc] || p->slot[pc] != p->cur)
+        profile_switch(p, pc);
+}
+
+#endif
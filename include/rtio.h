@@ -0,0 +1,66 @@
+#ifndef RTIO_H
+#define RTIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+Runtime I/O for executing programs.
+
+PRINT output is collected in one large buffer that is written out only when
+it fills up, before an interactive INPUT and at exit. An output with fd < 0
+is an in-memory sink: the buffer grows instead of being flushed.
+
+INPUT values come from the terminal or are replayed from a file or an
+in-memory array, so interactive programs can run unattended. A queue input
+is fed while the program runs; the VM blocks on it instead of failing when
+it is empty.
+*/
+
+#define RT_OUTPUT_CAP (64 * 1024)
+#define RT_TAB_WIDTH 8
+
+typedef struct rt_output {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fd;
+    int col;
+} rt_output;
+
+enum rt_input_kind
+{
+    RT_INPUT_STDIN,
+    RT_INPUT_REPLAY,
+    RT_INPUT_QUEUE
+};
+
+typedef struct rt_input {
+    enum rt_input_kind kind;
+    int16_t *values;
+    int count;
+    int pos;
+    int cap;
+} rt_input;
+
+rt_output *init_rt_output(int fd, size_t cap);
+void free_rt_output(rt_output *out);
+void rt_flush(rt_output *out);
+void rt_write(rt_output *out, const char *s, size_t len);
+void rt_write_str(rt_output *out, const char *s);
+void rt_write_char(rt_output *out, char c);
+void rt_write_int(rt_output *out, int value);
+void rt_write_tab(rt_output *out);
+
+rt_input *init_rt_input_stdin(void);
+rt_input *init_rt_input_values(const int16_t *values, int count);
+rt_input *init_rt_input_file(const char *path);
+rt_input *init_rt_input_queue(void);
+int rt_read_input_sets(const char *path, rt_input ***sets);
+void free_rt_input(rt_input *in);
+int rt_read_int(rt_input *in, int16_t *value);
+void rt_input_rewind(rt_input *in);
+void rt_input_push(rt_input *in, const int16_t *values, int count);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ir.h"
+#include "vm.h"
+#include "rtio.h"
+
+/*
+Multi-tenant scheduler: many BASIC programs in one process.
+
+Every program is a task around its own VM. The VM keeps all of a running
+program's state in its fields (pc, variables, GOSUB stack, memory pages),
+so it is already a stackless coroutine: vm_run_slice returns after a
+budget of instructions or when INPUT finds an empty queue, and calling it
+again resumes where it stopped. Tasks share one read-only ir_program.
+
+Each worker owns a deque of runnable tasks. It takes from the front and
+puts preempted tasks at the back; an idle worker steals from the back of
+another worker's deque. Blocked tasks sit in no deque until sched_feed
+gives them input.
+
+A task's output is held in memory until the host reads it, so a task
+whose output grows past SCHED_OUTPUT_LIMIT bytes fails with "output
+limit" at the end of its slice.
+*/
+
+#define SCHED_DEFAULT_BUDGET 10000
+#define SCHED_OUTPUT_CAP 64     // initial per-task output buffer, grows
+#define SCHED_OUTPUT_LIMIT (16 * 1024) // a task printing more fails
+
+enum sched_state
+{
+    TASK_RUNNABLE,      // queued or running
+    TASK_BLOCKED,
+    TASK_DONE
+};
+
+typedef struct sched_task {
+    int id;
+    enum sched_state state;
+    vm *m;
+    rt_output *out;
+    rt_input *in;
+
+    // input fed while the task is not blocked, taken over when it blocks
+    int16_t *pending;
+    int npending;
+    int pendcap;
+
+    uint64_t cpu_ns;    // thread CPU time spent in its slices
+    uint32_t slices;
+} sched_task;
+
+typedef struct sched_deque {
+    pthread_mutex_t lock;
+    sched_task **items;
+    int head;
+    int count;
+    int cap;
+} sched_deque;
+
+typedef struct sched_worker {
+    struct sched *s;
+    pthread_t thread;
+    int id;
+    sched_deque queue;
+
+    uint64_t switches;  // slices run
+    uint64_t preempted;
+    uint64_t blocked;
+    uint64_t steals;
+} sched_worker;
+
+typedef struct sched {
+    sched_worker *workers;
+    int nworkers;
+    long budget;
+
+    sched_task **tasks;
+    int ntasks;
+    int taskcap;
+    int next_worker;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // runnable tasks appeared
+    pthread_cond_t quiet;   // nothing runnable or running is left
+    atomic_int runnable;    // tasks sitting in deques
+    atomic_int idle;        // workers waiting for work
+    int active;             // tasks in TASK_RUNNABLE
+    int stopping;
+} sched;
+
+sched *init_sched(int workers, long budget);
+void free_sched(sched *s);
+
+sched_task *sched_spawn(sched *s, ir_program *ir, int cold_start);
+void sched_feed(sched *s, sched_task *t, const int16_t *values, int count);
+void sched_wait(sched *s);
+
+size_t sched_task_bytes(sched_task *t);
+void fprint_sched_stats(FILE *out, sched *s);
+void fprint_sched_tasks(FILE *out, sched *s);
+
+#endif
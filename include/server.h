@@ -0,0 +1,50 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+/*
+Compile daemon over a Unix domain socket.
+
+A connection carries any number of requests, answered in order. Every
+message is an 8-byte header of two host-order uint32 values followed by
+`length` bytes of body:
+
+| Message  | First word                  | Body                           |
+| -------- | --------------------------- | ------------------------------ |
+| request  | TB_OP_TOKENS/AST/IR         | program source                 |
+| response | TB_STATUS_OK/ERRORS/BAD_REQ | dump, then diagnostics if any  |
+
+An event loop owns every socket and a pool of workers compiles. Each
+worker keeps its own warm tb_context. Responses are cached by operation
+and source text, so repeated programs are not compiled again. A response
+whose source and dump together exceed TB_CACHE_ENTRY_MAX is not cached,
+and older entries are evicted to keep the cache within TB_CACHE_BYTES.
+*/
+
+#define TB_OP_TOKENS 1
+#define TB_OP_AST 2
+#define TB_OP_IR 3
+
+#define TB_STATUS_OK 0
+#define TB_STATUS_ERRORS 1
+#define TB_STATUS_BAD_REQUEST 2
+
+#define TB_MAX_REQUEST (1024 * 1024)
+#define TB_CACHE_SLOTS 1024
+#define TB_CACHE_BYTES (64 * 1024 * 1024)
+#define TB_CACHE_ENTRY_MAX (256 * 1024)
+
+typedef struct tb_header {
+    uint32_t word;
+    uint32_t length;
+} tb_header;
+
+// Serve on path until SIGINT or SIGTERM; workers <= 0 uses one per CPU.
+int tb_serve(const char *path, int workers);
+
+int tb_connect(const char *path);
+int tb_request(int fd, uint32_t op, const char *src, uint32_t len,
+               uint32_t *status, char **body, uint32_t *body_len);
+
+#endif
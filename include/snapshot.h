@@ -0,0 +1,73 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ir.h"
+#include "vm.h"
+#include "rtio.h"
+
+/*
+Snapshots of a stopped VM: the compiled program and the machine state.
+
+The file is the header below followed by the sections it points to, each
+8-byte aligned and stored in the in-memory layout, so loading it is one
+mmap. The IR's code and line table, and the memory pages, are used in
+place from a private mapping. Only the string table and the VM struct
+are built. A snapshot is tied to the build that wrote it: instr_size and
+the version catch layout changes.
+
+| Section | Contents                                   |
+| ------- | ------------------------------------------ |
+| code    | ir_instr[count]                            |
+| lines   | ir_line[nlines]                            |
+| strings | nstrings NUL-terminated strings            |
+| temps   | int16_t[ntemps + 1]                        |
+| pages   | one VM_PAGE_SIZE block per set page_map[i] |
+*/
+
+#define SNAPSHOT_MAGIC "TBSNAP\r\n"
+#define SNAPSHOT_VERSION 1
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t instr_size;
+    uint64_t size;
+
+    uint64_t code_off;
+    uint64_t lines_off;
+    uint64_t strings_off;
+    uint64_t temps_off;
+    uint64_t pages_off;
+    uint32_t count;
+    uint32_t nlines;
+    uint32_t nstrings;
+    uint32_t strings_len;
+    uint32_t ntemps;
+    uint32_t has_dynamic_jumps;
+
+    int32_t pc;
+    int32_t sp;
+    int32_t stack[VM_STACK_DEPTH];
+    int16_t vars[VM_NVARS];
+    int16_t usr_arg;
+    int16_t col;
+    int32_t cold_start;
+    int32_t prompted;
+    uint8_t page_map[VM_NPAGES];
+} snapshot_header;
+
+typedef struct snapshot {
+    void *base;
+    size_t size;
+    ir_program *ir;     // code and lines point into base
+    vm *m;
+} snapshot;
+
+int save_snapshot(vm *m, const char *path);
+snapshot *load_snapshot(const char *path, rt_output *out, rt_input *in);
+void free_snapshot(snapshot *s);
+
+#endif
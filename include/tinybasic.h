@@ -0,0 +1,45 @@
+#ifndef TINYBASIC_H
+#define TINYBASIC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "parse.h"
+#include "ir.h"
+
+/*
+libtinybasic: the compiler as an embeddable library.
+
+A tb_context owns everything one compilation produces: the copied source,
+tokens, ast and diagnostics live in its arena, the lowered IR next to it.
+Contexts share no state, so any number of threads can compile at once as
+long as each uses its own context. A context can be reused; every
+tb_parse() or tb_compile() first releases the previous results.
+
+Errors never terminate the process. They are returned as diagnostics and
+the program is built from the lines that did parse.
+*/
+
+typedef struct tb_context {
+    arena *mem;
+    char *src;
+    ast *program;
+    ir_program *ir;
+    diagnostic *diags;
+    int ndiags;
+} tb_context;
+
+tb_context *tb_init(void);
+void tb_free(tb_context *ctx);
+void tb_reset(tb_context *ctx);
+
+ast *tb_parse(tb_context *ctx, const char *src, size_t len);
+ir_program *tb_compile(tb_context *ctx, const char *src, size_t len, int optimize);
+
+int tb_diagnostic_count(tb_context *ctx);
+diagnostic *tb_diagnostic(tb_context *ctx, int i);
+void tb_fprint_diagnostics(FILE *out, tb_context *ctx, const char *filename);
+
+#endif
@@ -1,5 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
+
+#include "arena.h"
 /*
 | Type        | Examples                                            | Notes                                 |
 | ----------- | --------------------------------------------------- | ------------------------------------- |
@@ -11,6 +13,7 @@
 | Punctuation | `(`, `)`, `,`, `;`                                  | For grouping and PRINT formatting     |
 | String      | `"HELLO"`                                           | Only used in PRINT or REM             |
 | End-of-line | Implicit at each program line                       | Helps parser detect end of statement  |
+| Error       | `@`                                                 | Character the lexer cannot classify   |
 */
 
 enum token_type
@@ -23,16 +26,19 @@ enum token_type
     TOKEN_PUNCTUATION,
     TOKEN_STRING,
     TOKEN_EOL,
-    TOKEN_EOF
-}token_type;
+    TOKEN_EOF,
+    TOKEN_ERROR
+};
 
 typedef struct token
 {
     char *value;
     enum token_type type;
+    int line;
+    int col;
 } token;
 
-token *init_token(char *value, int type);
+token *init_token(arena *mem, char *value, int type);
 char *type_to_string(int token);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+
+#include "ir.h"
+#include "rtio.h"
+#include "profile.h"
+
+#define VM_NVARS 26
+#define VM_STACK_DEPTH 64
+
+/*
+USR(address, x, y) is not emulated: the addresses of the interpreter's PEEK
+and POKE routines, at fixed offsets from its cold start, are dispatched to
+loads and stores on a flat 64KB byte memory. The memory is paged and a
+page is allocated on its first POKE, so a program touching a few bytes
+stays small. Any other address is a runtime error.
+*/
+#define VM_MEMORY_SIZE 65536
+#define VM_PAGE_SIZE 1024
+#define VM_NPAGES (VM_MEMORY_SIZE / VM_PAGE_SIZE)
+#define VM_COLD_START 0x0100
+#define VM_USR_PEEK 20      // USR(G, addr): byte at addr
+#define VM_USR_POKE 24      // USR(P, addr, value): store the low byte
+
+enum vm_status
+{
+    VM_RUNNING,
+    VM_END,
+    VM_ERROR,
+    VM_YIELD,       // instruction budget used up, resume with vm_run_slice
+    VM_BLOCKED,     // INPUT on an empty queue, resume once it is fed
+    VM_BREAK        // about to execute break_pc, which is then cleared
+};
+
+typedef struct vm {
+    ir_program *ir;
+    rt_output *out;
+    rt_input *in;
+    profile *prof;      // NULL unless profiling
+
+    int pc;
+    int sp;
+    int stack[VM_STACK_DEPTH];
+    int16_t vars[VM_NVARS];
+    int16_t *temps;
+
+    uint8_t *pages[VM_NPAGES];
+    int cold_start;
+    int16_t usr_arg;
+    int prompted;       // "? " already written for a blocked INPUT
+    int break_pc;       // stop before this instruction, -1 for none
+
+    enum vm_status status;
+    const char *error;
+    int error_line;
+} vm;
+
+vm *init_vm(ir_program *ir, rt_output *out, rt_input *in);
+void free_vm(vm *m);
+void vm_reset(vm *m);
+enum vm_status vm_run(vm *m);
+enum vm_status vm_run_slice(vm *m, long budget);
+
+#endif
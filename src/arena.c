@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+static arena_block *new_block(size_t size)
+{
+    arena_block *b = malloc(sizeof(arena_block) + size);
+    b->next = NULL;
+    b->used = 0;
+    b->size = size;
+    return b;
+}
+
+arena *init_arena(size_t block_size)
+{
+    arena *mem = calloc(1, sizeof(arena));
+    mem->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+    mem->head = new_block(mem->block_size);
+    return mem;
+}
+
+void free_arena(arena *mem)
+{
+    if (!mem)
+        return;
+
+    arena_block *b = mem->head;
+    while (b) {
+        arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(mem);
+}
+
+// Drop every block except the oldest one, which stays warm for the next use.
+void arena_reset(arena *mem)
+{
+    arena_block *b = mem->head;
+    while (b->next) {
+        arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    b->used = 0;
+    mem->head = b;
+}
+
+// Memory is zeroed, like calloc.
+void *arena_alloc(arena *mem, size_t size)
+{
+    if (!mem)
+        return calloc(1, size);
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_block *b = mem->head;
+    if (b->used + size > b->size) {
+        size_t block = size > mem->block_size ? size : mem->block_size;
+        arena_block *fresh = new_block(block);
+
+        // Oversized requests get their own block behind the current one,
+        // so the partly used head keeps serving small allocations.
+        if (size > mem->block_size) {
+            fresh->next = b->next;
+            b->next = fresh;
+            fresh->used = size;
+            memset(fresh->data, 0, size);
+            return fresh->data;
+        }
+        fresh->next = b;
+        mem->head = b = fresh;
+    }
+
+    void *p = b->data + b->used;
+    b->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(arena *mem, const char *s, size_t len)
+{
+    char *copy = arena_alloc(mem, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
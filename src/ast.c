@@ -5,9 +5,9 @@
 
 #define INITIAL_CHILD_CAP 4
 
-ast* init_node(enum node_type type, token* tok)
+ast* init_node(arena* mem, enum node_type type, token* tok)
 {
-    ast* n = calloc(1, sizeof(ast));
+    ast* n = arena_alloc(mem, sizeof(ast));
     n->type = type;
     n->tok = tok;
     return n;
@@ -49,31 +49,38 @@ const char* node_type_to_string(enum node_type type)
         case INPUT_STATEMENT: return "INPUT";
         case EXPRESSION: return "EXPR";
         case STRING_LITERAL: return "STRING";
+        case PRINT_SEPARATOR: return "SEP";
+        case USR_CALL: return "USR";
         default: return "UNKNOWN";
     }
 }
 
 // Recursive function to print AST
-void print_ast(ast* node, int indent)
+void fprint_ast(FILE* out, ast* node, int indent)
 {
     if (!node) return;
 
     // indent
     for (int i = 0; i < indent; i++)
-        printf("  ");
+        fprintf(out, "  ");
 
     // print node type
-    printf("%s", node_type_to_string(node->type));
+    fprintf(out, "%s", node_type_to_string(node->type));
 
     // print token if present
     if (node->tok && node->tok->value)
-        printf(" (%s)", node->tok->value);
+        fprintf(out, " (%s)", node->tok->value);
 
-    printf("\n");
+    fprintf(out, "\n");
 
     // print children
-    print_ast(node->child, indent + 1);
+    fprint_ast(out, node->child, indent + 1);
 
     // print siblings at same indent
-    print_ast(node->sibling, indent);
+    fprint_ast(out, node->sibling, indent);
+}
+
+void print_ast(ast* node, int indent)
+{
+    fprint_ast(stdout, node, indent);
 }
@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_HAVE_AVX2 1
+#define BATCH_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "batch.h"
+
+typedef struct batch_kernels {
+    // dst = a op b for MOV, ADD, SUB, MUL and LT..NE, in the lanes of mask
+    void (*arith)(enum ir_opcode op, int16_t *dst, const int16_t *a, const int16_t *b, uint16_t mask);
+    // lanes where a rel b holds; rel counts from LT as in IR_JLT..IR_JNE
+    uint16_t (*compare)(int rel, const int16_t *a, const int16_t *b);
+} batch_kernels;
+
+enum { REL_LT, REL_LE, REL_GT, REL_GE, REL_EQ, REL_NE };
+
+static const int16_t zero_row[BATCH_WIDTH] __attribute__((aligned(32)));
+
+// ---------------- Scalar kernels ----------------
+static inline int relation(int rel, int a, int b)
+{
+    switch (rel) {
+        case REL_LT: return a < b;
+        case REL_LE: return a <= b;
+        case REL_GT: return a > b;
+        case REL_GE: return a >= b;
+        case REL_EQ: return a == b;
+        default: return a != b;
+    }
+}
+
+static void arith_scalar(enum ir_opcode op, int16_t *dst, const int16_t *a, const int16_t *b, uint16_t mask)
+{
+    for (int i = 0; i < BATCH_WIDTH; i++) {
+        if (!(mask & (1u << i)))
+            continue;
+        switch (op) {
+            case IR_MOV: dst[i] = a[i]; break;
+            case IR_ADD: dst[i] = (int16_t)(a[i] + b[i]); break;
+            case IR_SUB: dst[i] = (int16_t)(a[i] - b[i]); break;
+            case IR_MUL: dst[i] = (int16_t)(a[i] * b[i]); break;
+            default: dst[i] = relation(op - IR_LT, a[i], b[i]); break;
+        }
+    }
+}
+
+static uint16_t compare_scalar(int rel, const int16_t *a, const int16_t *b)
+{
+    uint16_t mask = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++)
+        mask |= relation(rel, a[i], b[i]) << i;
+    return mask;
+}
+
+static const batch_kernels scalar_kernels = { arith_scalar, compare_scalar };
+
+// ---------------- AVX2 kernels ----------------
+#ifdef BATCH_HAVE_AVX2
+// All-ones in the 16-bit lanes whose bit is set in mask.
+BATCH_AVX2 static inline __m256i lanes_avx2(uint16_t mask)
+{
+    const __m256i bits = _mm256_setr_epi16(
+        0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+        0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, (int16_t)0x8000);
+    __m256i m = _mm256_and_si256(_mm256_set1_epi16((int16_t)mask), bits);
+    return _mm256_cmpeq_epi16(m, bits);
+}
+
+BATCH_AVX2 static inline __m256i relation_avx2(int rel, __m256i a, __m256i b)
+{
+    const __m256i ones = _mm256_set1_epi16(-1);
+    switch (rel) {
+        case REL_LT: return _mm256_cmpgt_epi16(b, a);
+        case REL_LE: return _mm256_xor_si256(_mm256_cmpgt_epi16(a, b), ones);
+        case REL_GT: return _mm256_cmpgt_epi16(a, b);
+        case REL_GE: return _mm256_xor_si256(_mm256_cmpgt_epi16(b, a), ones);
+        case REL_EQ: return _mm256_cmpeq_epi16(a, b);
+        default: return _mm256_xor_si256(_mm256_cmpeq_epi16(a, b), ones);
+    }
+}
+
+BATCH_AVX2 static void arith_avx2(enum ir_opcode op, int16_t *dst, const int16_t *a, const int16_t *b, uint16_t mask)
+{
+    __m256i va = _mm256_load_si256((const __m256i *)a);
+    __m256i vb = _mm256_load_si256((const __m256i *)b);
+    __m256i r;
+
+    switch (op) {
+        case IR_MOV: r = va; break;
+        case IR_ADD: r = _mm256_add_epi16(va, vb); break;
+        case IR_SUB: r = _mm256_sub_epi16(va, vb); break;
+        case IR_MUL: r = _mm256_mullo_epi16(va, vb); break;
+        default: r = _mm256_srli_epi16(relation_avx2(op - IR_LT, va, vb), 15); break;
+    }
+
+    if (mask != 0xffff) {
+        __m256i old = _mm256_load_si256((const __m256i *)dst);
+        r = _mm256_blendv_epi8(old, r, lanes_avx2(mask));
+    }
+    _mm256_store_si256((__m256i *)dst, r);
+}
+
+BATCH_AVX2 static uint16_t compare_avx2(int rel, const int16_t *a, const int16_t *b)
+{
+    __m256i va = _mm256_load_si256((const __m256i *)a);
+    __m256i vb = _mm256_load_si256((const __m256i *)b);
+    __m256i c = relation_avx2(rel, va, vb);
+
+    // packing to bytes leaves lanes 0-7 in bytes 0-7 and lanes 8-15 in 16-23
+    uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_packs_epi16(c, c));
+    return (uint16_t)((bits & 0xff) | ((bits >> 8) & 0xff00));
+}
+
+static const batch_kernels avx2_kernels = { arith_avx2, compare_avx2 };
+#endif
+
+static int cpu_has_avx2(void)
+{
+#ifdef BATCH_HAVE_AVX2
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return 0;
+#endif
+}
+
+// ---------------- Batch ----------------
+// Takes over the inputs; the array itself stays the caller's.
+batch *init_batch(ir_program *ir, rt_input **inputs, int nlanes)
+{
+    batch *b = calloc(1, sizeof(batch));
+    b->ir = ir;
+    b->nlanes = nlanes;
+    b->nblocks = (nlanes + BATCH_WIDTH - 1) / BATCH_WIDTH;
+    b->nslots = VM_NVARS + ir->ntemps + 1;
+    b->cold_start = VM_COLD_START;
+    b->budget = BATCH_DEFAULT_BUDGET;
+    b->simd = cpu_has_avx2();
+
+    size_t row = BATCH_WIDTH * sizeof(int16_t);
+    b->regs = aligned_alloc(32, (size_t)b->nblocks * b->nslots * row + 32);
+    memset(b->regs, 0, (size_t)b->nblocks * b->nslots * row);
+
+    b->consts = aligned_alloc(32, (size_t)ir->count * 2 * row + 32);
+    for (int pc = 0; pc < ir->count; pc++) {
+        const ir_instr *in = &ir->code[pc];
+        int16_t *ra = b->consts + (size_t)pc * 2 * BATCH_WIDTH;
+        for (int i = 0; i < BATCH_WIDTH; i++) {
+            ra[i] = in->a.kind == OPERAND_CONST ? (int16_t)in->a.value : 0;
+            ra[BATCH_WIDTH + i] = in->b.kind == OPERAND_CONST ? (int16_t)in->b.value : 0;
+        }
+    }
+
+    b->lanes = calloc(nlanes ? nlanes : 1, sizeof(batch_lane));
+    for (int i = 0; i < nlanes; i++) {
+        b->lanes[i].in = inputs[i];
+        b->lanes[i].out = init_rt_output(-1, BATCH_OUTPUT_CAP);
+    }
+    return b;
+}
+
+void free_batch(batch *b)
+{
+    if (!b)
+        return;
+
+    for (int i = 0; i < b->nlanes; i++) {
+        batch_lane *l = &b->lanes[i];
+        free_rt_input(l->in);
+        free_rt_output(l->out);
+        if (l->pages)
+            for (int p = 0; p < VM_NPAGES; p++)
+                free(l->pages[p]);
+        free(l->pages);
+    }
+    free(b->lanes);
+    free(b->consts);
+    free(b->regs);
+    free(b);
+}
+
+// The row an operand reads or writes; which is 0 for a, 1 for b.
+static inline int16_t *row(batch *b, int16_t *regs, int pc, ir_operand o, int which)
+{
+    switch (o.kind) {
+        case OPERAND_VAR: return regs + o.value * BATCH_WIDTH;
+        case OPERAND_TEMP: return regs + (VM_NVARS + o.value) * BATCH_WIDTH;
+        case OPERAND_CONST: return b->consts + ((size_t)pc * 2 + which) * BATCH_WIDTH;
+        default: return (int16_t *)zero_row;
+    }
+}
+
+static void fail_lanes(batch *b, int blk, batch_warp *w, uint16_t mask, int pc, const char *msg)
+{
+    for (int i = 0; i < BATCH_WIDTH; i++) {
+        if (!(mask & (1u << i)))
+            continue;
+        batch_lane *l = &b->lanes[blk * BATCH_WIDTH + i];
+        l->status = VM_ERROR;
+        l->error = msg;
+        l->error_line = pc < b->ir->count ? b->ir->code[pc].line : 0;
+    }
+    w->mask &= ~mask;
+}
+
+// Lane output is kept in memory until the batch is done, so a lane that
+// prints without end is stopped instead of exhausting memory.
+static void limit_output(batch *b, int blk, batch_warp *w, int pc)
+{
+    uint16_t over = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++)
+        if ((w->mask & (1u << i)) && b->lanes[blk * BATCH_WIDTH + i].out->len > BATCH_OUTPUT_LIMIT)
+            over |= 1u << i;
+    if (over)
+        fail_lanes(b, blk, w, over, pc, "output limit");
+}
+
+// Add the warp's pending steps to each of its lanes.
+static void sync_steps(batch *b, int blk, batch_warp *w)
+{
+    long base = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++) {
+        if (!(w->mask & (1u << i)))
+            continue;
+        batch_lane *l = &b->lanes[blk * BATCH_WIDTH + i];
+        l->steps += w->steps;
+        if (l->steps > base)
+            base = l->steps;
+    }
+    w->steps = 0;
+    w->base = base;
+}
+
+// Hand the steps run since *start over to the warp.
+static void add_steps(batch *b, batch_warp *w, uint64_t *start)
+{
+    w->steps += b->warp_steps - *start;
+    *start = b->warp_steps;
+}
+
+// Called once the warp's most advanced lane is at the budget.
+static void limit_steps(batch *b, int blk, batch_warp *w, int pc)
+{
+    sync_steps(b, blk, w);
+    uint16_t over = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++)
+        if ((w->mask & (1u << i)) && b->lanes[blk * BATCH_WIDTH + i].steps >= b->budget)
+            over |= 1u << i;
+    fail_lanes(b, blk, w, over, pc, "budget exceeded");
+    sync_steps(b, blk, w);
+}
+
+static void end_lanes(batch *b, int blk, batch_warp *w)
+{
+    for (int i = 0; i < BATCH_WIDTH; i++)
+        if (w->mask & (1u << i))
+            b->lanes[blk * BATCH_WIDTH + i].status = VM_END;
+    w->mask = 0;
+}
+
+// Move the lanes of mask into a new warp of the block at pc.
+static void split(batch *b, batch_warp *w, uint16_t mask, int pc)
+{
+    batch_warp *nw = &b->warps[b->nwarps++];
+    nw->pc = pc;
+    nw->mask = mask;
+    nw->sp = w->sp;
+    memcpy(nw->stack, w->stack, w->sp * sizeof(int));
+    nw->steps = w->steps;
+    nw->base = w->base;
+    w->mask &= ~mask;
+    b->splits++;
+}
+
+// Computed GOTO/GOSUB: w keeps the lanes going where its first lane goes,
+// every other target gets a warp of its own.
+static void scatter(batch *b, batch_warp *w, const int *targets)
+{
+    int first = __builtin_ctz(w->mask);
+    int pc = targets[first];
+    uint16_t rest = w->mask & ~(1u << first);
+
+    for (int i = first + 1; i < BATCH_WIDTH; i++)
+        if ((rest & (1u << i)) && targets[i] == pc)
+            rest &= ~(1u << i);
+
+    while (rest) {
+        int lane = __builtin_ctz(rest);
+        uint16_t group = 0;
+        for (int i = lane; i < BATCH_WIDTH; i++)
+            if ((rest & (1u << i)) && targets[i] == targets[lane])
+                group |= 1u << i;
+        split(b, w, group, targets[lane]);
+        rest &= ~group;
+    }
+    w->pc = pc;
+}
+
+static uint8_t **lane_pages(batch_lane *l)
+{
+    if (!l->pages)
+        l->pages = calloc(VM_NPAGES, sizeof(uint8_t *));
+    return l->pages;
+}
+
+// Run one warp until it ends, splits, takes a jump while other warps wait,
+// or arrives at limit, where another warp may be merged with it.
+static void run_warp(batch *b, int blk, batch_warp *w, int limit, const batch_kernels *k)
+{
+    const ir_instr *code = b->ir->code;
+    int count = b->ir->count;
+    int16_t *regs = b->regs + (size_t)blk * b->nslots * BATCH_WIDTH;
+    batch_lane *lanes = b->lanes + blk * BATCH_WIDTH;
+    int pc = w->pc;
+    uint64_t start = b->warp_steps;
+
+    // steps are counted once per warp; the budget is checked at jumps,
+    // since straight-line code ends by itself
+    while (pc < count && pc != limit && w->mask) {
+        const ir_instr *in = &code[pc];
+        uint16_t taken = 0;
+        int16_t *dst;
+        int targets[BATCH_WIDTH];
+
+        b->warp_steps++;
+        b->lane_steps += __builtin_popcount(w->mask);
+
+        switch (in->op) {
+        case IR_NOP:
+            break;
+        case IR_MOV: case IR_ADD: case IR_SUB: case IR_MUL:
+        case IR_LT: case IR_LE: case IR_GT:
+        case IR_GE: case IR_EQ: case IR_NE:
+            k->arith(in->op, row(b, regs, pc, in->dst, 0), row(b, regs, pc, in->a, 0),
+                     row(b, regs, pc, in->b, 1), w->mask);
+            break;
+        case IR_DIV: {
+            const int16_t *a = row(b, regs, pc, in->a, 0), *d = row(b, regs, pc, in->b, 1);
+            dst = row(b, regs, pc, in->dst, 0);
+            uint16_t zero = k->compare(REL_EQ, d, zero_row) & w->mask;
+            if (zero)
+                fail_lanes(b, blk, w, zero, pc, "division by zero");
+            for (int i = 0; i < BATCH_WIDTH; i++)
+                if (w->mask & (1u << i))
+                    dst[i] = (int16_t)(a[i] / d[i]);
+            break;
+        }
+
+        case IR_JMP:
+            taken = w->mask;
+            goto branch;
+        case IR_JZ:
+        case IR_JNZ:
+            taken = k->compare(in->op == IR_JNZ ? REL_NE : REL_EQ, row(b, regs, pc, in->a, 0), zero_row);
+            goto branch;
+        case IR_JLT: case IR_JLE: case IR_JGT:
+        case IR_JGE: case IR_JEQ: case IR_JNE:
+            taken = k->compare(in->op - IR_JLT, row(b, regs, pc, in->a, 0), row(b, regs, pc, in->b, 1));
+            goto branch;
+        case IR_LOOP_LT: case IR_LOOP_LE: case IR_LOOP_GT:
+        case IR_LOOP_GE: case IR_LOOP_EQ: case IR_LOOP_NE:
+            dst = row(b, regs, pc, in->dst, 0);
+            k->arith(IR_ADD, dst, dst, row(b, regs, pc, in->a, 0), w->mask);
+            taken = k->compare(in->op - IR_LOOP_LT, dst, row(b, regs, pc, in->b, 1));
+        branch:
+            taken &= w->mask;
+            if (!taken)
+                break;
+            if (in->target < 0) {
+                fail_lanes(b, blk, w, taken, pc, "undefined line");
+                break;
+            }
+            if (taken != w->mask) {
+                add_steps(b, w, &start);
+                split(b, w, taken, in->target);
+                w->pc = pc + 1;
+                return;
+            }
+            pc = in->target;
+            goto jumped;
+
+        case IR_GOSUB:
+        case IR_GOSUB_LINE:
+        case IR_GOTO_LINE:
+            if (in->op != IR_GOTO_LINE && w->sp == VM_STACK_DEPTH) {
+                fail_lanes(b, blk, w, w->mask, pc, "GOSUB nesting too deep");
+                break;
+            }
+            if (in->op == IR_GOSUB) {
+                if (in->target < 0) {
+                    fail_lanes(b, blk, w, w->mask, pc, "undefined line");
+                    break;
+                }
+                w->stack[w->sp++] = pc + 1;
+                pc = in->target;
+                goto jumped;
+            }
+            {
+                const int16_t *a = row(b, regs, pc, in->a, 0);
+                uint16_t undefined = 0;
+                for (int i = 0; i < BATCH_WIDTH; i++) {
+                    if (!(w->mask & (1u << i)))
+                        continue;
+                    targets[i] = ir_find_line(b->ir, a[i]);
+                    if (targets[i] < 0)
+                        undefined |= 1u << i;
+                }
+                if (undefined)
+                    fail_lanes(b, blk, w, undefined, pc, "undefined line");
+                if (!w->mask)
+                    break;
+                if (in->op == IR_GOSUB_LINE)
+                    w->stack[w->sp++] = pc + 1;
+                add_steps(b, w, &start);
+                scatter(b, w, targets);
+                return;
+            }
+        case IR_RETURN:
+            if (w->sp == 0) {
+                fail_lanes(b, blk, w, w->mask, pc, "RETURN without GOSUB");
+                break;
+            }
+            pc = w->stack[--w->sp];
+        jumped:
+            add_steps(b, w, &start);
+            if (w->base + w->steps >= b->budget) {
+                limit_steps(b, blk, w, pc);
+                if (!w->mask)
+                    goto yield;
+            }
+            if (b->nwarps > 1)
+                goto yield;
+            continue;
+        case IR_END:
+            end_lanes(b, blk, w);
+            break;
+
+        case IR_PRINT:
+            for (int i = 0; i < BATCH_WIDTH; i++) {
+                if (!(w->mask & (1u << i)))
+                    continue;
+                if (in->a.kind == OPERAND_STRING)
+                    rt_write_str(lanes[i].out, b->ir->strings[in->a.value]);
+                else
+                    rt_write_int(lanes[i].out, row(b, regs, pc, in->a, 0)[i]);
+            }
+            limit_output(b, blk, w, pc);
+            break;
+        case IR_PRINT_TAB:
+            for (int i = 0; i < BATCH_WIDTH; i++)
+                if (w->mask & (1u << i))
+                    rt_write_tab(lanes[i].out);
+            limit_output(b, blk, w, pc);
+            break;
+        case IR_PRINT_NL:
+            for (int i = 0; i < BATCH_WIDTH; i++)
+                if (w->mask & (1u << i))
+                    rt_write_char(lanes[i].out, '\n');
+            limit_output(b, blk, w, pc);
+            break;
+        case IR_INPUT: {
+            uint16_t empty = 0;
+            dst = row(b, regs, pc, in->dst, 0);
+            for (int i = 0; i < BATCH_WIDTH; i++) {
+                int16_t value;
+                if (!(w->mask & (1u << i)))
+                    continue;
+                rt_write_str(lanes[i].out, "? ");
+                if (!rt_read_int(lanes[i].in, &value)) {
+                    empty |= 1u << i;
+                    continue;
+                }
+                // echoed as in a replayed VM run
+                rt_write_int(lanes[i].out, value);
+                rt_write_char(lanes[i].out, '\n');
+                dst[i] = value;
+            }
+            if (empty)
+                fail_lanes(b, blk, w, empty, pc, "out of input");
+            limit_output(b, blk, w, pc);
+            break;
+        }
+
+        case IR_USR_ARG: {
+            const int16_t *a = row(b, regs, pc, in->a, 0);
+            for (int i = 0; i < BATCH_WIDTH; i++)
+                if (w->mask & (1u << i))
+                    lanes[i].usr_arg = a[i];
+            break;
+        }
+        case IR_USR: {
+            const int16_t *a = row(b, regs, pc, in->a, 0), *addr = row(b, regs, pc, in->b, 1);
+            uint16_t unsupported = 0;
+            dst = row(b, regs, pc, in->dst, 0);
+            for (int i = 0; i < BATCH_WIDTH; i++) {
+                if (!(w->mask & (1u << i)))
+                    continue;
+                uint16_t at = (uint16_t)addr[i];
+                uint8_t **page;
+                switch ((uint16_t)(a[i] - b->cold_start)) {
+                case VM_USR_PEEK:
+                    page = lanes[i].pages ? &lanes[i].pages[at / VM_PAGE_SIZE] : NULL;
+                    dst[i] = page && *page ? (*page)[at % VM_PAGE_SIZE] : 0;
+                    break;
+                case VM_USR_POKE:
+                    page = &lane_pages(&lanes[i])[at / VM_PAGE_SIZE];
+                    if (!*page)
+                        *page = calloc(VM_PAGE_SIZE, 1);
+                    dst[i] = (*page)[at % VM_PAGE_SIZE] = (uint8_t)lanes[i].usr_arg;
+                    break;
+                default:
+                    unsupported |= 1u << i;
+                    continue;
+                }
+                lanes[i].usr_arg = 0;
+            }
+            if (unsupported)
+                fail_lanes(b, blk, w, unsupported, pc, "USR routine not supported");
+            break;
+        }
+        }
+        pc++;
+    }
+
+    if (pc >= count)
+        end_lanes(b, blk, w);
+yield:
+    add_steps(b, w, &start);
+    w->pc = pc;
+}
+
+// Drop finished warps and merge those at the same pc with the same stack.
+static void merge_warps(batch *b, int blk)
+{
+    for (int i = 0; i < b->nwarps; i++) {
+        batch_warp *w = &b->warps[i];
+        for (int j = i + 1; j < b->nwarps && w->mask; j++) {
+            batch_warp *o = &b->warps[j];
+            if (o->mask && o->pc == w->pc && o->sp == w->sp &&
+                memcmp(o->stack, w->stack, w->sp * sizeof(int)) == 0)
+            {
+                sync_steps(b, blk, w);
+                sync_steps(b, blk, o);
+                w->mask |= o->mask;
+                w->base = w->base > o->base ? w->base : o->base;
+                o->mask = 0;
+                b->merges++;
+            }
+        }
+    }
+
+    int n = 0;
+    for (int i = 0; i < b->nwarps; i++)
+        if (b->warps[i].mask)
+            b->warps[n++] = b->warps[i];
+    b->nwarps = n;
+}
+
+static void run_block(batch *b, int blk, const batch_kernels *k)
+{
+    int lanes = b->nlanes - blk * BATCH_WIDTH;
+    batch_warp *w = &b->warps[0];
+    w->pc = 0;
+    w->sp = 0;
+    w->mask = lanes >= BATCH_WIDTH ? 0xffff : (uint16_t)((1u << lanes) - 1);
+    w->steps = 0;
+    w->base = 0;
+    b->nwarps = 1;
+
+    for (;;) {
+        merge_warps(b, blk);
+        if (b->nwarps == 0)
+            return;
+
+        // deepest GOSUB nesting first, so returned warps wait for the
+        // rest; then lowest pc, up to where the next warp is waiting
+        int first = 0, limit = INT_MAX;
+        for (int i = 1; i < b->nwarps; i++) {
+            batch_warp *w = &b->warps[i], *f = &b->warps[first];
+            if (w->sp > f->sp || (w->sp == f->sp && w->pc < f->pc))
+                first = i;
+        }
+        for (int i = 0; i < b->nwarps; i++)
+            if (b->warps[i].pc > b->warps[first].pc && b->warps[i].pc < limit)
+                limit = b->warps[i].pc;
+
+        run_warp(b, blk, &b->warps[first], limit, k);
+    }
+}
+
+void batch_run(batch *b)
+{
+    const batch_kernels *k = &scalar_kernels;
+#ifdef BATCH_HAVE_AVX2
+    if (b->simd && cpu_has_avx2())
+        k = &avx2_kernels;
+    else
+        b->simd = 0;
+#else
+    b->simd = 0;
+#endif
+
+    for (int blk = 0; blk < b->nblocks; blk++)
+        run_block(b, blk, k);
+}
+
+void fprint_batch_stats(FILE *out, batch *b)
+{
+    int ended = 0, failed = 0;
+    for (int i = 0; i < b->nlanes; i++) {
+        ended += b->lanes[i].status == VM_END;
+        failed += b->lanes[i].status == VM_ERROR;
+    }
+
+    fprintf(out, "batch of %d lanes in %d blocks of %d, %s kernels: %d ended, %d failed\n",
+            b->nlanes, b->nblocks, BATCH_WIDTH, b->simd ? "AVX2" : "scalar", ended, failed);
+    fprintf(out, "warp steps %llu, lane steps %llu, lane utilization %.1f%%; splits %llu, merges %llu\n",
+            (unsigned long long)b->warp_steps, (unsigned long long)b->lane_steps,
+            b->warp_steps ? 100.0 * b->lane_steps / (b->warp_steps * BATCH_WIDTH) : 0.0,
+            (unsigned long long)b->splits, (unsigned long long)b->merges);
+}
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ir.h"
+#include "ast.h"
+#include "token.h"
+
+#define INITIAL_CODE_CAP 64
+
+static const ir_operand no_operand = { OPERAND_NONE, 0 };
+
+// ---------------- Program management ----------------
+ir_program *init_ir_program(void)
+{
+    ir_program *ir = calloc(1, sizeof(ir_program));
+    ir->cap = INITIAL_CODE_CAP;
+    ir->code = malloc(ir->cap * sizeof(ir_instr));
+    return ir;
+}
+
+void free_ir_program(ir_program *ir)
+{
+    if (!ir)
+        return;
+
+    for (int i = 0; i < ir->nstrings; i++)
+        free(ir->strings[i]);
+    free(ir->strings);
+    free(ir->lines);
+    free(ir->loops);
+    free(ir->code);
+    free(ir);
+}
+
+int ir_emit(ir_program *ir, enum ir_opcode op, ir_operand dst, ir_operand a, ir_operand b)
+{
+    if (ir->count == ir->cap) {
+        ir->cap *= 2;
+        ir->code = realloc(ir->code, ir->cap * sizeof(ir_instr));
+    }
+
+    ir_instr *in = &ir->code[ir->count];
+    in->op = op;
+    in->dst = dst;
+    in->a = a;
+    in->b = b;
+    in->target = -1;
+    in->line = ir->nlines ? ir->lines[ir->nlines - 1].line : 0;
+    return ir->count++;
+}
+
+static void add_line(ir_program *ir, int line)
+{
+    if (ir->nlines == ir->linecap) {
+        ir->linecap = ir->linecap ? ir->linecap * 2 : 16;
+        ir->lines = realloc(ir->lines, ir->linecap * sizeof(ir_line));
+    }
+    ir->lines[ir->nlines].line = line;
+    ir->lines[ir->nlines].index = ir->count;
+    ir->nlines++;
+}
+
+static int add_string(ir_program *ir, const char *s)
+{
+    if (ir->nstrings == ir->strcap) {
+        ir->strcap = ir->strcap ? ir->strcap * 2 : 16;
+        ir->strings = realloc(ir->strings, ir->strcap * sizeof(char *));
+    }
+    ir->strings[ir->nstrings] = strdup(s ? s : "");
+    return ir->nstrings++;
+}
+
+// Index of a BASIC line in ir->lines, or -1. The parser only accepts
+// ascending line numbers, so a binary search is enough.
+int ir_line_slot(ir_program *ir, int line)
+{
+    int lo = 0, hi = ir->nlines - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (ir->lines[mid].line == line)
+            return mid;
+        if (ir->lines[mid].line < line)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+// First instruction of a BASIC line, or -1.
+int ir_find_line(ir_program *ir, int line)
+{
+    int slot = ir_line_slot(ir, line);
+    return slot < 0 ? -1 : ir->lines[slot].index;
+}
+
+// Drop IR_NOPs and remap jump targets and the line table.
+void ir_compact(ir_program *ir)
+{
+    int *remap = malloc((ir->count + 1) * sizeof(int));
+    int kept = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        remap[i] = kept;
+        if (ir->code[i].op != IR_NOP)
+            kept++;
+    }
+    remap[ir->count] = kept;
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr in = ir->code[i];
+        if (in.op == IR_NOP)
+            continue;
+        if (in.target >= 0)
+            in.target = remap[in.target];
+        ir->code[remap[i]] = in;
+    }
+
+    for (int i = 0; i < ir->nlines; i++)
+        ir->lines[i].index = remap[ir->lines[i].index];
+
+    ir->count = kept;
+    free(remap);
+}
+
+// ---------------- Lowering ----------------
+typedef struct fixup {
+    int index;
+    int line;
+} fixup;
+
+typedef struct lowering {
+    ir_program *ir;
+    fixup *fixups;
+    int nfixups;
+    int fixcap;
+} lowering;
+
+static ir_operand operand(enum ir_operand_kind kind, int value)
+{
+    ir_operand o = { kind, value };
+    return o;
+}
+
+static ir_operand new_temp(ir_program *ir)
+{
+    return operand(OPERAND_TEMP, ir->ntemps++);
+}
+
+static void add_fixup(lowering *lw, int index, int line)
+{
+    if (lw->nfixups == lw->fixcap) {
+        lw->fixcap = lw->fixcap ? lw->fixcap * 2 : 16;
+        lw->fixups = realloc(lw->fixups, lw->fixcap * sizeof(fixup));
+    }
+    lw->fixups[lw->nfixups].index = index;
+    lw->fixups[lw->nfixups].line = line;
+    lw->nfixups++;
+}
+
+static enum ir_opcode binary_opcode(const char *op)
+{
+    if (strcmp(op, "+") == 0) return IR_ADD;
+    if (strcmp(op, "-") == 0) return IR_SUB;
+    if (strcmp(op, "*") == 0) return IR_MUL;
+    if (strcmp(op, "/") == 0) return IR_DIV;
+    if (strcmp(op, "<") == 0) return IR_LT;
+    if (strcmp(op, "<=") == 0) return IR_LE;
+    if (strcmp(op, ">") == 0) return IR_GT;
+    if (strcmp(op, ">=") == 0) return IR_GE;
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return IR_EQ;
+    if (strcmp(op, "<>") == 0) return IR_NE;
+    return IR_NOP;
+}
+
+static ir_operand lower_expr(lowering *lw, ast *e)
+{
+    ir_program *ir = lw->ir;
+
+    if (e->type == STRING_LITERAL)
+        return operand(OPERAND_STRING, add_string(ir, e->tok->value));
+
+    token *t = e->tok;
+    if (t->type == TOKEN_NUMBER)
+        return operand(OPERAND_CONST, atoi(t->value));
+    if (t->type == TOKEN_IDENTIFIER)
+        return operand(OPERAND_VAR, toupper((unsigned char)t->value[0]) - 'A');
+
+    // the optional third argument is passed right before the call
+    if (e->type == USR_CALL) {
+        ir_operand args[3] = { no_operand, no_operand, no_operand };
+        int n = 0;
+        for (ast *arg = e->child; arg; arg = arg->sibling)
+            args[n++] = lower_expr(lw, arg);
+        if (n == 3)
+            ir_emit(ir, IR_USR_ARG, no_operand, args[2], no_operand);
+        ir_operand dst = new_temp(ir);
+        ir_emit(ir, IR_USR, dst, args[0], args[1]);
+        return dst;
+    }
+
+    // unary minus is lowered as 0 - x
+    if (!e->child->sibling) {
+        ir_operand x = lower_expr(lw, e->child);
+        ir_operand dst = new_temp(ir);
+        ir_emit(ir, IR_SUB, dst, operand(OPERAND_CONST, 0), x);
+        return dst;
+    }
+
+    ir_operand a = lower_expr(lw, e->child);
+    ir_operand b = lower_expr(lw, e->child->sibling);
+    ir_operand dst = new_temp(ir);
+    ir_emit(ir, binary_opcode(t->value), dst, a, b);
+    return dst;
+}
+
+// Store an expression into a variable, retargeting the defining
+// instruction instead of emitting a copy when the value is a fresh temp.
+static void lower_assign(lowering *lw, ir_operand var, ast *e)
+{
+    ir_program *ir = lw->ir;
+    ir_operand v = lower_expr(lw, e);
+
+    if (v.kind == OPERAND_TEMP && ir->count > 0 &&
+        ir->code[ir->count - 1].dst.kind == OPERAND_TEMP &&
+        ir->code[ir->count - 1].dst.value == v.value)
+    {
+        ir->code[ir->count - 1].dst = var;
+        return;
+    }
+    ir_emit(ir, IR_MOV, var, v, no_operand);
+}
+
+static void lower_jump(lowering *lw, enum ir_opcode op, ir_operand a, token *num)
+{
+    int at = ir_emit(lw->ir, op, no_operand, a, no_operand);
+    add_fixup(lw, at, atoi(num->value));
+}
+
+// GOTO/GOSUB carry the line number in tok, or a child expression when the
+// target is computed at run time.
+static void lower_transfer(lowering *lw, ast *stmt, enum ir_opcode op, enum ir_opcode computed)
+{
+    if (stmt->tok) {
+        lower_jump(lw, op, no_operand, stmt->tok);
+        return;
+    }
+
+    ir_operand line = lower_expr(lw, stmt->child);
+    ir_emit(lw->ir, computed, no_operand, line, no_operand);
+    lw->ir->has_dynamic_jumps = 1;
+}
+
+static void lower_print(lowering *lw, ast *stmt)
+{
+    ir_program *ir = lw->ir;
+    ast *last = NULL;
+
+    for (ast *item = stmt->child; item; item = item->sibling) {
+        last = item;
+        if (item->type != PRINT_SEPARATOR)
+            ir_emit(ir, IR_PRINT, no_operand, lower_expr(lw, item), no_operand);
+        else if (strcmp(item->tok->value, ",") == 0)
+            ir_emit(ir, IR_PRINT_TAB, no_operand, no_operand, no_operand);
+    }
+
+    // a trailing separator keeps the cursor on the same line
+    if (!last || last->type != PRINT_SEPARATOR)
+        ir_emit(ir, IR_PRINT_NL, no_operand, no_operand, no_operand);
+}
+
+static void lower_statement(lowering *lw, ast *stmt);
+
+// IF ... THEN number and IF ... THEN GOTO number jump to a line; any other
+// statement is skipped when the condition is false.
+static void lower_if(lowering *lw, ast *stmt)
+{
+    ir_program *ir = lw->ir;
+    ast *relop = stmt->child;
+    ast *then = relop->sibling;
+
+    ir_operand a = lower_expr(lw, relop->child);
+    ir_operand b = lower_expr(lw, relop->child->sibling);
+    ir_operand cond = new_temp(ir);
+    ir_emit(ir, binary_opcode(relop->tok->value), cond, a, b);
+
+    if (then->type == EXPRESSION || (then->type == GO_TO_STATEMENT && then->tok)) {
+        lower_jump(lw, IR_JNZ, cond, then->tok);
+        return;
+    }
+
+    int skip = ir_emit(ir, IR_JZ, no_operand, cond, no_operand);
+    lower_statement(lw, then);
+    ir->code[skip].target = ir->count;
+}
+
+static void lower_statement(lowering *lw, ast *stmt)
+{
+    ir_program *ir = lw->ir;
+
+    switch (stmt->type) {
+    case LET_STATEMENT: {
+        ast *eq = stmt->child;
+        ast *var = eq->child;
+        lower_assign(lw, lower_expr(lw, var), var->sibling);
+        break;
+    }
+    case PRINT_STATEMENT:
+        lower_print(lw, stmt);
+        break;
+    case INPUT_STATEMENT:
+        ir_emit(ir, IR_INPUT,
+                operand(OPERAND_VAR, toupper((unsigned char)stmt->tok->value[0]) - 'A'),
+                no_operand, no_operand);
+        break;
+    case IF_STATEMENT:
+        lower_if(lw, stmt);
+        break;
+    case GO_TO_STATEMENT:
+        lower_transfer(lw, stmt, IR_JMP, IR_GOTO_LINE);
+        break;
+    case GO_SUB_STATEMENT:
+        lower_transfer(lw, stmt, IR_GOSUB, IR_GOSUB_LINE);
+        break;
+    case RETURN_STATEMENT:
+        ir_emit(ir, IR_RETURN, no_operand, no_operand, no_operand);
+        break;
+    case END_STATEMENT:
+        ir_emit(ir, IR_END, no_operand, no_operand, no_operand);
+        break;
+    default:
+        // REM lines produce no code
+        break;
+    }
+}
+
+ir_program *ir_lower(ast *prog)
+{
+    lowering lw = { init_ir_program(), NULL, 0, 0 };
+
+    for (ast *line = prog->child; line; line = line->sibling) {
+        add_line(lw.ir, atoi(line->tok->value));
+        for (ast *stmt = line->child; stmt; stmt = stmt->sibling)
+            lower_statement(&lw, stmt);
+    }
+
+    for (int i = 0; i < lw.nfixups; i++) {
+        ir_instr *in = &lw.ir->code[lw.fixups[i].index];
+        // a missing line stays -1 and is reported if the jump is executed
+        in->target = ir_find_line(lw.ir, lw.fixups[i].line);
+    }
+
+    free(lw.fixups);
+    return lw.ir;
+}
+
+// ---------------- Dump ----------------
+const char *ir_opcode_to_string(enum ir_opcode op)
+{
+    switch (op) {
+        case IR_NOP: return "nop";
+        case IR_MOV: return "mov";
+        case IR_ADD: return "+";
+        case IR_SUB: return "-";
+        case IR_MUL: return "*";
+        case IR_DIV: return "/";
+        case IR_LT: return "<";
+        case IR_LE: return "<=";
+        case IR_GT: return ">";
+        case IR_GE: return ">=";
+        case IR_EQ: return "=";
+        case IR_NE: return "<>";
+        case IR_JMP: return "goto";
+        case IR_JZ: return "ifnot";
+        case IR_JNZ: return "if";
+        case IR_JLT: return "<";
+        case IR_JLE: return "<=";
+        case IR_JGT: return ">";
+        case IR_JGE: return ">=";
+        case IR_JEQ: return "=";
+        case IR_JNE: return "<>";
+        case IR_LOOP_LT: return "<";
+        case IR_LOOP_LE: return "<=";
+        case IR_LOOP_GT: return ">";
+        case IR_LOOP_GE: return ">=";
+        case IR_LOOP_EQ: return "=";
+        case IR_LOOP_NE: return "<>";
+        case IR_GOTO_LINE: return "goto line";
+        case IR_GOSUB: return "gosub";
+        case IR_GOSUB_LINE: return "gosub line";
+        case IR_RETURN: return "return";
+        case IR_END: return "end";
+        case IR_PRINT: return "print";
+        case IR_PRINT_TAB: return "print tab";
+        case IR_PRINT_NL: return "print nl";
+        case IR_INPUT: return "input";
+        case IR_USR_ARG: return "usr arg";
+        case IR_USR: return "usr";
+        default: return "unknown";
+    }
+}
+
+static void fprint_operand(FILE *out, ir_program *ir, ir_operand o)
+{
+    switch (o.kind) {
+    case OPERAND_CONST: fprintf(out, "%d", o.value); break;
+    case OPERAND_VAR: fprintf(out, "%c", 'A' + o.value); break;
+    case OPERAND_TEMP: fprintf(out, "t%d", o.value); break;
+    case OPERAND_STRING: fprintf(out, "\"%s\"", ir->strings[o.value]); break;
+    default: fprintf(out, "_"); break;
+    }
+}
+
+static void fprint_instr(FILE *out, ir_program *ir, ir_instr *in)
+{
+    const char *name = ir_opcode_to_string(in->op);
+
+    switch (in->op) {
+    case IR_MOV:
+        fprint_operand(out, ir, in->dst);
+        fprintf(out, " = ");
+        fprint_operand(out, ir, in->a);
+        break;
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+        fprint_operand(out, ir, in->dst);
+        fprintf(out, " = ");
+        fprint_operand(out, ir, in->a);
+        fprintf(out, " %s ", name);
+        fprint_operand(out, ir, in->b);
+        break;
+    case IR_JZ: case IR_JNZ:
+        fprintf(out, "%s ", name);
+        fprint_operand(out, ir, in->a);
+        fprintf(out, " goto %d", in->target);
+        break;
+    case IR_JLT: case IR_JLE: case IR_JGT: case IR_JGE: case IR_JEQ: case IR_JNE:
+        fprintf(out, "if ");
+        fprint_operand(out, ir, in->a);
+        fprintf(out, " %s ", name);
+        fprint_operand(out, ir, in->b);
+        fprintf(out, " goto %d", in->target);
+        break;
+    case IR_LOOP_LT: case IR_LOOP_LE: case IR_LOOP_GT:
+    case IR_LOOP_GE: case IR_LOOP_EQ: case IR_LOOP_NE:
+        fprintf(out, "loop ");
+        fprint_operand(out, ir, in->dst);
+        fprintf(out, " += ");
+        fprint_operand(out, ir, in->a);
+        fprintf(out, " if ");
+        fprint_operand(out, ir, in->dst);
+        fprintf(out, " %s ", name);
+        fprint_operand(out, ir, in->b);
+        fprintf(out, " goto %d", in->target);
+        break;
+    case IR_JMP: case IR_GOSUB:
+        fprintf(out, "%s %d", name, in->target);
+        break;
+    case IR_USR:
+        fprint_operand(out, ir, in->dst);
+        fprintf(out, " = %s ", name);
+        fprint_operand(out, ir, in->a);
+        if (in->b.kind != OPERAND_NONE) {
+            fprintf(out, ", ");
+            fprint_operand(out, ir, in->b);
+        }
+        break;
+    case IR_GOTO_LINE: case IR_GOSUB_LINE: case IR_PRINT: case IR_USR_ARG:
+        fprintf(out, "%s ", name);
+        fprint_operand(out, ir, in->a);
+        break;
+    case IR_INPUT:
+        fprintf(out, "%s ", name);
+        fprint_operand(out, ir, in->dst);
+        break;
+    default:
+        fprintf(out, "%s", name);
+        break;
+    }
+}
+
+void fprint_ir(FILE *out, ir_program *ir)
+{
+    int l = 0;
+
+    for (int i = 0; i <= ir->count; i++) {
+        for (; l < ir->nlines && ir->lines[l].index == i; l++)
+            fprintf(out, "L%d:\n", ir->lines[l].line);
+        if (i == ir->count)
+            break;
+
+        fprintf(out, "%6d  ", i);
+        fprint_instr(out, ir, &ir->code[i]);
+        fprintf(out, "\n");
+    }
+}
+
+void fprint_ir_loops(FILE *out, ir_program *ir)
+{
+    for (int i = 0; i < ir->nloops; i++) {
+        ir_loop *l = &ir->loops[i];
+        fprintf(out, "loop L%d-L%d:", l->first_line, l->last_line);
+        if (l->var >= 0)
+            fprintf(out, " induction %c step %d,", 'A' + l->var, l->step);
+        fprintf(out, " %d hoisted, %d strength-reduced%s\n",
+                l->hoisted, l->reduced, l->counted ? ", counted" : "");
+    }
+}
+
+void print_ir(ir_program *ir)
+{
+    fprint_ir(stdout, ir);
+}
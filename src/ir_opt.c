@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir.h"
+
+#define READS_A 1
+#define READS_B 2
+#define NVARS 26
+
+static const ir_operand no_operand = { OPERAND_NONE, 0 };
+
+// ---------------- Instruction properties ----------------
+static int reads(enum ir_opcode op)
+{
+    switch (op) {
+    case IR_MOV: case IR_JZ: case IR_JNZ:
+    case IR_GOTO_LINE: case IR_GOSUB_LINE: case IR_PRINT: case IR_USR_ARG:
+        return READS_A;
+    case IR_USR:
+        return READS_A | READS_B;
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+    case IR_JLT: case IR_JLE: case IR_JGT: case IR_JGE: case IR_JEQ: case IR_JNE:
+    case IR_LOOP_LT: case IR_LOOP_LE: case IR_LOOP_GT:
+    case IR_LOOP_GE: case IR_LOOP_EQ: case IR_LOOP_NE:
+        return READS_A | READS_B;
+    default:
+        return 0;
+    }
+}
+
+static int is_binary(enum ir_opcode op)
+{
+    return op >= IR_ADD && op <= IR_NE;
+}
+
+static int is_compare(enum ir_opcode op)
+{
+    return op >= IR_LT && op <= IR_NE;
+}
+
+// Counted loop latches also read their destination.
+static int is_loop(enum ir_opcode op)
+{
+    return op >= IR_LOOP_LT && op <= IR_LOOP_NE;
+}
+
+static int defines(ir_instr *in)
+{
+    return in->op == IR_MOV || is_binary(in->op) || in->op == IR_INPUT ||
+           in->op == IR_USR || is_loop(in->op);
+}
+
+// Instructions that can be deleted when their result is unused. A division
+// by a non-constant may trap, so it is kept for its side effect.
+static int removable(ir_instr *in)
+{
+    if (in->op == IR_DIV)
+        return in->b.kind == OPERAND_CONST && in->b.value != 0;
+    return in->op == IR_MOV || is_binary(in->op);
+}
+
+static int ends_block(enum ir_opcode op)
+{
+    switch (op) {
+    case IR_JMP: case IR_JZ: case IR_JNZ:
+    case IR_JLT: case IR_JLE: case IR_JGT: case IR_JGE: case IR_JEQ: case IR_JNE:
+    case IR_LOOP_LT: case IR_LOOP_LE: case IR_LOOP_GT:
+    case IR_LOOP_GE: case IR_LOOP_EQ: case IR_LOOP_NE:
+    case IR_GOTO_LINE: case IR_GOSUB: case IR_GOSUB_LINE:
+    case IR_RETURN: case IR_END:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int same(ir_operand x, ir_operand y)
+{
+    return x.kind == y.kind && x.value == y.value;
+}
+
+static int is_slot(ir_operand o)
+{
+    return o.kind == OPERAND_VAR || o.kind == OPERAND_TEMP;
+}
+
+// Variables and temps share one index space: A..Z first, then t0, t1, ...
+static int slot(ir_operand o)
+{
+    return o.kind == OPERAND_VAR ? o.value : NVARS + o.value;
+}
+
+static int mentions(ir_operand x, ir_operand o)
+{
+    return is_slot(o) && same(x, o);
+}
+
+// A block starts at the program entry, at every jump target and after every
+// control transfer. With computed GOTO/GOSUB any line may be entered.
+static char *find_leaders(ir_program *ir)
+{
+    char *leader = calloc(ir->count + 1, 1);
+    leader[0] = 1;
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr *in = &ir->code[i];
+        if (ends_block(in->op))
+            leader[i + 1] = 1;
+        if (in->target >= 0)
+            leader[in->target] = 1;
+    }
+
+    if (ir->has_dynamic_jumps)
+        for (int i = 0; i < ir->nlines; i++)
+            leader[ir->lines[i].index] = 1;
+
+    return leader;
+}
+
+static int *count_temp_uses(ir_program *ir)
+{
+    int *uses = calloc(ir->ntemps + 1, sizeof(int));
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr *in = &ir->code[i];
+        int r = reads(in->op);
+        if ((r & READS_A) && in->a.kind == OPERAND_TEMP)
+            uses[in->a.value]++;
+        if ((r & READS_B) && in->b.kind == OPERAND_TEMP)
+            uses[in->b.value]++;
+    }
+    return uses;
+}
+
+// ---------------- Common subexpression elimination ----------------
+typedef struct available {
+    enum ir_opcode op;
+    ir_operand a;
+    ir_operand b;
+    ir_operand result;
+} available;
+
+static int commutative(enum ir_opcode op)
+{
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE;
+}
+
+// Canonical order for commutative operands: slots first, constants last.
+static int operand_rank(ir_operand o)
+{
+    return o.kind == OPERAND_CONST ? OPERAND_STRING + 1 : o.kind;
+}
+
+static int operand_less(ir_operand x, ir_operand y)
+{
+    int rx = operand_rank(x), ry = operand_rank(y);
+    return rx < ry || (rx == ry && x.value < y.value);
+}
+
+int ir_pass_cse(ir_program *ir)
+{
+    char *leader = find_leaders(ir);
+    available *avail = malloc((ir->count + 1) * sizeof(available));
+    ir_operand *rename = calloc(ir->ntemps + 1, sizeof(ir_operand));
+    int navail = 0;
+    int changed = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr *in = &ir->code[i];
+        int r = reads(in->op);
+
+        if (leader[i])
+            navail = 0;
+
+        if ((r & READS_A) && in->a.kind == OPERAND_TEMP && rename[in->a.value].kind)
+            in->a = rename[in->a.value];
+        if ((r & READS_B) && in->b.kind == OPERAND_TEMP && rename[in->b.value].kind)
+            in->b = rename[in->b.value];
+
+        if (is_binary(in->op)) {
+            if (commutative(in->op) && operand_less(in->b, in->a)) {
+                ir_operand t = in->a;
+                in->a = in->b;
+                in->b = t;
+            }
+
+            int e;
+            for (e = 0; e < navail; e++)
+                if (avail[e].op == in->op && same(avail[e].a, in->a) && same(avail[e].b, in->b))
+                    break;
+
+            if (e < navail) {
+                changed++;
+                if (in->dst.kind == OPERAND_TEMP && avail[e].result.kind == OPERAND_TEMP) {
+                    rename[in->dst.value] = avail[e].result;
+                    in->op = IR_NOP;
+                    continue;
+                }
+                in->op = IR_MOV;
+                in->a = avail[e].result;
+                in->b = no_operand;
+            }
+        }
+
+        if (!defines(in))
+            continue;
+
+        int kept = 0;
+        for (int e = 0; e < navail; e++) {
+            if (mentions(in->dst, avail[e].a) || mentions(in->dst, avail[e].b) ||
+                same(in->dst, avail[e].result))
+                continue;
+            avail[kept++] = avail[e];
+        }
+        navail = kept;
+
+        if (is_binary(in->op) && !same(in->dst, in->a) && !same(in->dst, in->b)) {
+            avail[navail].op = in->op;
+            avail[navail].a = in->a;
+            avail[navail].b = in->b;
+            avail[navail].result = in->dst;
+            navail++;
+        }
+    }
+
+    free(rename);
+    free(avail);
+    free(leader);
+    return changed;
+}
+
+// ---------------- Copy propagation ----------------
+int ir_pass_copy_propagation(ir_program *ir)
+{
+    char *leader = find_leaders(ir);
+    int nslots = NVARS + ir->ntemps;
+    ir_operand *copy = calloc(nslots, sizeof(ir_operand));
+    int *active = malloc(nslots * sizeof(int));
+    int nactive = 0;
+    int changed = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr *in = &ir->code[i];
+        int r = reads(in->op);
+
+        if (leader[i]) {
+            for (int k = 0; k < nactive; k++)
+                copy[active[k]].kind = OPERAND_NONE;
+            nactive = 0;
+        }
+
+        if ((r & READS_A) && is_slot(in->a) && copy[slot(in->a)].kind) {
+            in->a = copy[slot(in->a)];
+            changed++;
+        }
+        if ((r & READS_B) && is_slot(in->b) && copy[slot(in->b)].kind) {
+            in->b = copy[slot(in->b)];
+            changed++;
+        }
+
+        if (!defines(in))
+            continue;
+
+        // The destination is overwritten: forget its copy and every copy of it.
+        int kept = 0;
+        for (int k = 0; k < nactive; k++) {
+            int s = active[k];
+            if (s == slot(in->dst) || same(copy[s], in->dst)) {
+                copy[s].kind = OPERAND_NONE;
+                continue;
+            }
+            active[kept++] = s;
+        }
+        nactive = kept;
+
+        if (in->op == IR_MOV && !same(in->a, in->dst)) {
+            copy[slot(in->dst)] = in->a;
+            active[nactive++] = slot(in->dst);
+        }
+    }
+
+    free(active);
+    free(copy);
+    free(leader);
+    return changed;
+}
+
+// ---------------- Dead-store elimination ----------------
+int ir_pass_dead_stores(ir_program *ir)
+{
+    int changed = 0;
+    int again;
+
+    // Temps whose value is never read.
+    do {
+        int *uses = count_temp_uses(ir);
+        again = 0;
+        for (int i = 0; i < ir->count; i++) {
+            ir_instr *in = &ir->code[i];
+            if (removable(in) && in->dst.kind == OPERAND_TEMP && uses[in->dst.value] == 0) {
+                in->op = IR_NOP;
+                changed++;
+                again = 1;
+            }
+        }
+        free(uses);
+    } while (again);
+
+    // Variables overwritten later in the same block before any read.
+    // Every variable is assumed live when the block is left.
+    char *leader = find_leaders(ir);
+    char dead[NVARS];
+
+    for (int i = ir->count - 1; i >= 0; i--) {
+        ir_instr *in = &ir->code[i];
+        int r = reads(in->op);
+
+        if (i == ir->count - 1 || leader[i + 1])
+            memset(dead, 0, sizeof(dead));
+
+        if (in->op == IR_NOP)
+            continue;
+
+        if (defines(in) && in->dst.kind == OPERAND_VAR) {
+            if (removable(in) && dead[in->dst.value]) {
+                in->op = IR_NOP;
+                changed++;
+                continue;
+            }
+            dead[in->dst.value] = 1;
+        }
+
+        if ((r & READS_A) && in->a.kind == OPERAND_VAR)
+            dead[in->a.value] = 0;
+        if ((r & READS_B) && in->b.kind == OPERAND_VAR)
+            dead[in->b.value] = 0;
+        if (is_loop(in->op) && in->dst.kind == OPERAND_VAR)
+            dead[in->dst.value] = 0;
+    }
+
+    free(leader);
+    return changed;
+}
+
+// ---------------- Peephole ----------------
+static enum ir_opcode invert_compare(enum ir_opcode op)
+{
+    switch (op) {
+        case IR_LT: return IR_GE;
+        case IR_LE: return IR_GT;
+        case IR_GT: return IR_LE;
+        case IR_GE: return IR_LT;
+        case IR_EQ: return IR_NE;
+        default: return IR_EQ;
+    }
+}
+
+static enum ir_opcode compare_jump(enum ir_opcode op)
+{
+    return IR_JLT + (op - IR_LT);
+}
+
+static int next_instr(ir_program *ir, int i)
+{
+    do {
+        i++;
+    } while (i < ir->count && ir->code[i].op == IR_NOP);
+    return i;
+}
+
+int ir_pass_peephole(ir_program *ir)
+{
+    int *uses = count_temp_uses(ir);
+    int changed = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        ir_instr *in = &ir->code[i];
+        int n = next_instr(ir, i);
+        ir_instr *next = n < ir->count ? &ir->code[n] : NULL;
+
+        // t = a relop b; if t goto L  =>  if a relop b goto L
+        if (is_compare(in->op) && in->dst.kind == OPERAND_TEMP && next &&
+            (next->op == IR_JZ || next->op == IR_JNZ) &&
+            same(next->a, in->dst) && uses[in->dst.value] == 1)
+        {
+            enum ir_opcode cmp = next->op == IR_JNZ ? in->op : invert_compare(in->op);
+            in->op = compare_jump(cmp);
+            in->dst = no_operand;
+            in->target = next->target;
+            next->op = IR_NOP;
+            changed++;
+            continue;
+        }
+
+        // Branch on a constant condition.
+        if ((in->op == IR_JZ || in->op == IR_JNZ) && in->a.kind == OPERAND_CONST) {
+            int taken = (in->op == IR_JNZ) == (in->a.value != 0);
+            in->op = taken ? IR_JMP : IR_NOP;
+            in->a = no_operand;
+            changed++;
+            continue;
+        }
+
+        // Jump to the next instruction.
+        if (in->op == IR_JMP && in->target == n) {
+            in->op = IR_NOP;
+            changed++;
+        }
+    }
+
+    free(uses);
+    return changed;
+}
+
+// ---------------- Loops ----------------
+/*
+A loop is a backward jump from a latch to the first instruction of a line,
+the header. It is transformed only when nothing outside it jumps into its
+body, so the header is the single entry. Computed GOTO/GOSUB could enter
+any line and disable the pass. A loop that calls a subroutine may have any
+variable changed under it and only gets its latch fused.
+*/
+
+typedef struct reduction {
+    int mul;        // t = V * k inside the body
+    int update;     // V = V + c
+    int inc;        // c * k
+} reduction;
+
+static int is_branch(enum ir_opcode op)
+{
+    return op == IR_JMP || op == IR_JZ || op == IR_JNZ ||
+           (op >= IR_JLT && op <= IR_JNE) || is_loop(op);
+}
+
+static int is_line_start(ir_program *ir, int index)
+{
+    for (int i = 0; i < ir->nlines; i++)
+        if (ir->lines[i].index == index)
+            return 1;
+    return 0;
+}
+
+static int single_entry(ir_program *ir, int head, int latch)
+{
+    for (int i = 0; i < ir->count; i++) {
+        int t = ir->code[i].target;
+        if ((i < head || i > latch) && t > head && t <= latch)
+            return 0;
+    }
+    return 1;
+}
+
+// V = V + c or V = V - c; returns c through step.
+static int is_increment(ir_instr *in, int *step)
+{
+    if (in->dst.kind != OPERAND_VAR)
+        return 0;
+    if (in->op == IR_ADD && same(in->a, in->dst) && in->b.kind == OPERAND_CONST) {
+        *step = in->b.value;
+        return 1;
+    }
+    if (in->op == IR_ADD && same(in->b, in->dst) && in->a.kind == OPERAND_CONST) {
+        *step = in->a.value;
+        return 1;
+    }
+    if (in->op == IR_SUB && same(in->a, in->dst) && in->b.kind == OPERAND_CONST) {
+        *step = -in->b.value;
+        return 1;
+    }
+    return 0;
+}
+
+// Open n NOPs before index at. Jumps to at land on the first of them.
+static void insert_nops(ir_program *ir, int at, int n)
+{
+    while (ir->count + n > ir->cap) {
+        ir->cap *= 2;
+        ir->code = realloc(ir->code, ir->cap * sizeof(ir_instr));
+    }
+    memmove(&ir->code[at + n], &ir->code[at], (ir->count - at) * sizeof(ir_instr));
+    ir->count += n;
+
+    for (int i = 0; i < ir->count; i++)
+        if (ir->code[i].target > at)
+            ir->code[i].target += n;
+    for (int i = 0; i < ir->nlines; i++)
+        if (ir->lines[i].index > at)
+            ir->lines[i].index += n;
+
+    for (int i = at; i < at + n; i++) {
+        ir->code[i].op = IR_NOP;
+        ir->code[i].target = -1;
+        ir->code[i].line = ir->code[at + n].line;
+    }
+}
+
+static enum ir_opcode swap_compare_jump(enum ir_opcode op)
+{
+    switch (op) {
+        case IR_JLT: return IR_JGT;
+        case IR_JLE: return IR_JGE;
+        case IR_JGT: return IR_JLT;
+        case IR_JGE: return IR_JLE;
+        default: return op;
+    }
+}
+
+// V = V + c; if V relop limit goto head  =>  one IR_LOOP_* instruction.
+static int fuse_latch(ir_program *ir, int head, int latch, ir_loop *rec)
+{
+    ir_instr *br = &ir->code[latch];
+    if (br->op < IR_JLT || br->op > IR_JNE)
+        return 0;
+
+    int u = latch - 1;
+    while (u >= head && ir->code[u].op == IR_NOP)
+        u--;
+    int step;
+    if (u < head || !is_increment(&ir->code[u], &step))
+        return 0;
+
+    for (int i = 0; i < ir->count; i++)
+        if (ir->code[i].target > u && ir->code[i].target <= latch)
+            return 0;
+
+    ir_instr *inc = &ir->code[u];
+    enum ir_opcode op = br->op;
+    ir_operand limit;
+    if (same(br->a, inc->dst) && !same(br->b, inc->dst)) {
+        limit = br->b;
+    } else if (same(br->b, inc->dst) && !same(br->a, inc->dst)) {
+        limit = br->a;
+        op = swap_compare_jump(op);
+    } else {
+        return 0;
+    }
+
+    inc->op = IR_LOOP_LT + (op - IR_JLT);
+    inc->a = (ir_operand){ OPERAND_CONST, step };
+    inc->b = limit;
+    inc->target = br->target;
+    br->op = IR_NOP;
+    br->target = -1;
+
+    rec->var = inc->dst.value;
+    rec->step = step;
+    rec->counted = 1;
+    return 1;
+}
+
+// Transform the loop [head, *latch]; *latch is moved past inserted code.
+static int transform_loop(ir_program *ir, int head, int *latch)
+{
+    int end = *latch;
+    int calls = 0;
+    int defs[NVARS] = { 0 };
+    int update[NVARS];
+    int step[NVARS];
+    int *tdefs = calloc(ir->ntemps + 1, sizeof(int));
+    char *invariant = calloc(ir->ntemps + 1, 1);
+    int *hoist = malloc((end - head + 1) * sizeof(int));
+    reduction *red = malloc((end - head + 1) * sizeof(reduction));
+    int nhoist = 0, nred = 0;
+
+    ir_loop rec = {
+        .first_line = ir->code[head].line,
+        .last_line = ir->code[end].line,
+        .var = -1,
+    };
+
+    for (int i = head; i <= end; i++) {
+        ir_instr *in = &ir->code[i];
+        if (in->op == IR_GOSUB || in->op == IR_GOSUB_LINE)
+            calls = 1;
+        if (!defines(in))
+            continue;
+        if (in->dst.kind == OPERAND_VAR) {
+            defs[in->dst.value]++;
+            update[in->dst.value] = i;
+        } else if (in->dst.kind == OPERAND_TEMP) {
+            tdefs[in->dst.value]++;
+        }
+    }
+
+    for (int v = 0; v < NVARS && !calls; v++)
+        if (defs[v] == 1 && !is_increment(&ir->code[update[v]], &step[v]))
+            defs[v] = 2;
+
+    // Invariant code: operands are constants, variables the loop never
+    // writes, or temps computed by instructions already hoisted.
+    for (int i = head; i <= end && !calls; i++) {
+        ir_instr *in = &ir->code[i];
+        if (!removable(in) || in->dst.kind != OPERAND_TEMP || tdefs[in->dst.value] != 1)
+            continue;
+
+        int r = reads(in->op), ok = 1;
+        ir_operand ops[2] = { in->a, in->b };
+        for (int k = 0; k < 2; k++) {
+            if (!(r & (k ? READS_B : READS_A)))
+                continue;
+            if (ops[k].kind == OPERAND_VAR && defs[ops[k].value])
+                ok = 0;
+            if (ops[k].kind == OPERAND_TEMP && !invariant[ops[k].value])
+                ok = 0;
+        }
+        if (ok) {
+            invariant[in->dst.value] = 1;
+            hoist[nhoist++] = i;
+        }
+    }
+
+    // t = V * k with V stepped once per iteration becomes t += c * k next to
+    // the step, unless t is read across the step.
+    for (int i = head; i <= end && !calls; i++) {
+        ir_instr *in = &ir->code[i];
+        if (in->op != IR_MUL || in->dst.kind != OPERAND_TEMP ||
+            tdefs[in->dst.value] != 1 || invariant[in->dst.value])
+            continue;
+
+        ir_operand v = in->a, k = in->b;
+        if (v.kind == OPERAND_CONST) {
+            v = in->b;
+            k = in->a;
+        }
+        if (v.kind != OPERAND_VAR || k.kind != OPERAND_CONST || defs[v.value] != 1)
+            continue;
+
+        int u = update[v.value], ok = 1;
+        for (int x = i + 1; x <= end; x++) {
+            int r = reads(ir->code[x].op);
+            if (((r & READS_A) && same(ir->code[x].a, in->dst)) ||
+                ((r & READS_B) && same(ir->code[x].b, in->dst)))
+                if (i < u && u < x)
+                    ok = 0;
+        }
+        if (!ok)
+            continue;
+
+        red[nred].mul = i;
+        red[nred].update = u;
+        red[nred].inc = step[v.value] * k.value;
+        nred++;
+        rec.var = v.value;
+        rec.step = step[v.value];
+    }
+
+    // Preheader contents: hoisted code in order, then the initial products.
+    int npre = nhoist + nred;
+    ir_instr *pre = malloc((npre + 1) * sizeof(ir_instr));
+    for (int i = 0; i < nhoist; i++) {
+        pre[i] = ir->code[hoist[i]];
+        ir->code[hoist[i]].op = IR_NOP;
+    }
+    for (int i = 0; i < nred; i++) {
+        pre[nhoist + i] = ir->code[red[i].mul];
+        ir->code[red[i].mul].op = IR_NOP;
+    }
+
+    // Step the products right before their variable, latest first so the
+    // indices still to be used stay valid.
+    for (int done = 0; done < nred; done++) {
+        int r = 0;
+        for (int i = 1; i < nred; i++)
+            if (red[i].update > red[r].update)
+                r = i;
+
+        int u = red[r].update;
+        ir_operand t = pre[nhoist + r].dst;
+        insert_nops(ir, u, 1);
+        ir_instr *in = &ir->code[u];
+        in->op = IR_ADD;
+        in->dst = t;
+        in->a = t;
+        in->b = (ir_operand){ OPERAND_CONST, red[r].inc };
+        red[r].update = -1;
+        end++;
+    }
+
+    if (npre) {
+        insert_nops(ir, head, npre);
+        for (int i = 0; i < npre; i++) {
+            pre[i].line = ir->code[head].line;
+            ir->code[head + i] = pre[i];
+        }
+        for (int i = head + npre; i <= end + npre; i++)
+            if (ir->code[i].target == head)
+                ir->code[i].target = head + npre;
+        head += npre;
+        end += npre;
+    }
+
+    rec.hoisted = nhoist;
+    rec.reduced = nred;
+    fuse_latch(ir, head, end, &rec);
+
+    int changed = rec.hoisted + rec.reduced + rec.counted;
+    if (changed) {
+        if (ir->nloops == ir->loopcap) {
+            ir->loopcap = ir->loopcap ? ir->loopcap * 2 : 8;
+            ir->loops = realloc(ir->loops, ir->loopcap * sizeof(ir_loop));
+        }
+        ir->loops[ir->nloops++] = rec;
+    }
+
+    *latch = end;
+    free(pre);
+    free(red);
+    free(hoist);
+    free(invariant);
+    free(tdefs);
+    return changed;
+}
+
+int ir_pass_loops(ir_program *ir)
+{
+    int changed = 0;
+
+    ir->nloops = 0;
+    if (ir->has_dynamic_jumps)
+        return 0;
+
+    for (int j = 0; j < ir->count; j++) {
+        ir_instr *in = &ir->code[j];
+        if (!is_branch(in->op) || is_loop(in->op) || in->target < 0 || in->target > j)
+            continue;
+        if (!is_line_start(ir, in->target) || !single_entry(ir, in->target, j))
+            continue;
+        changed += transform_loop(ir, in->target, &j);
+    }
+    return changed;
+}
+
+// ---------------- Pass manager ----------------
+static const ir_pass default_passes[] = {
+    { "cse", ir_pass_cse },
+    { "copy-propagation", ir_pass_copy_propagation },
+    { "dead-stores", ir_pass_dead_stores },
+    { "peephole", ir_pass_peephole },
+    { "loops", ir_pass_loops },
+};
+
+// Run each pass, compact after it and report how many instructions it
+// inserted and removed. Returns the net number removed.
+int ir_run_passes(ir_program *ir, const ir_pass *passes, int npasses, FILE *report)
+{
+    int total_inserted = 0, total_removed = 0;
+
+    if (report)
+        fprintf(report, "%-18s %8s %8s %8s\n", "pass", "changed", "inserted", "removed");
+
+    for (int p = 0; p < npasses; p++) {
+        int before = ir->count;
+        int changed = passes[p].run(ir);
+        int inserted = ir->count - before;
+        int after_run = ir->count;
+        ir_compact(ir);
+
+        int removed = after_run - ir->count;
+        total_inserted += inserted;
+        total_removed += removed;
+        if (report)
+            fprintf(report, "%-18s %8d %8d %8d\n", passes[p].name, changed, inserted, removed);
+    }
+
+    if (report)
+        fprintf(report, "%-18s %8s %8d %8d\n", "total", "", total_inserted, total_removed);
+    return total_removed - total_inserted;
+}
+
+int ir_optimize(ir_program *ir, FILE *report)
+{
+    int removed = ir_run_passes(ir, default_passes,
+                                sizeof(default_passes) / sizeof(default_passes[0]), report);
+    if (report)
+        fprint_ir_loops(report, ir);
+    return removed;
+}
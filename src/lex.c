@@ -14,6 +14,7 @@ static int is_keyword(const char *s)
     static const char *kw[] = {
         "LET", "PRINT", "IF", "THEN", "GOTO",
         "GOSUB", "RETURN", "END", "INPUT", "REM",
+        "GO", "TO", "SUB", "USR",
         NULL
     };
 
@@ -25,22 +26,33 @@ static int is_keyword(const char *s)
 }
 
 // -------------------- Lexer init / helpers --------------------
-lexer *init_lexer(char *src)
+lexer *init_lexer(arena *mem, char *src)
 {
-    lexer *lex = calloc(1, sizeof(lexer));
+    lexer *lex = arena_alloc(mem, sizeof(lexer));
     lex->src = src;
     lex->pos = 0;
     lex->line = 1;
     lex->col = 0;
+    lex->mem = mem;
     return lex;
 }
 
 char lexer_peek(lexer *lex) { return lex->src[lex->pos]; }
 
+static token *scan_token(lexer *lex);
+
+// The parser peeks far more often than it consumes, so the scanned token
+// is cached until next_token() takes it.
 token *lexer_peek_next_token(lexer *lex)
 {
-    lexer temp = *lex;
-    return next_token(&temp);
+    if (!lex->ahead) {
+        lexer temp = *lex;
+        lex->ahead = scan_token(&temp);
+        lex->ahead_pos = temp.pos;
+        lex->ahead_line = temp.line;
+        lex->ahead_col = temp.col;
+    }
+    return lex->ahead;
 }
 
 char advance_lexer(lexer *lex)
@@ -70,14 +82,24 @@ void skip_whitespace(lexer *lex)
 // -------------------- Tokenizer --------------------
 token *next_token(lexer *lex)
 {
-    skip_whitespace(lex);
-
+    if (lex->ahead) {
+        token *t = lex->ahead;
+        lex->ahead = NULL;
+        lex->pos = lex->ahead_pos;
+        lex->line = lex->ahead_line;
+        lex->col = lex->ahead_col;
+        return t;
+    }
+    return scan_token(lex);
+}
 
+static token *lex_token(lexer *lex)
+{
     char c = lexer_peek(lex);
 
     if (c == '\0') 
     {
-        return init_token(NULL, TOKEN_EOF);
+        return init_token(lex->mem, NULL, TOKEN_EOF);
     }
 
     if (isdigit(c)) 
@@ -99,56 +121,56 @@ token *next_token(lexer *lex)
     {
         case '\n':
             advance_lexer(lex);
-            return init_token("\n", TOKEN_EOL);
+            return init_token(lex->mem, "\n", TOKEN_EOL);
         case '+':
             advance_lexer(lex);
-            return init_token("+", TOKEN_OPERATOR);
+            return init_token(lex->mem, "+", TOKEN_OPERATOR);
         case '-':
             advance_lexer(lex);
-            return init_token("-", TOKEN_OPERATOR);
+            return init_token(lex->mem, "-", TOKEN_OPERATOR);
         case '*':
             advance_lexer(lex);
-            return init_token("*", TOKEN_OPERATOR);
+            return init_token(lex->mem, "*", TOKEN_OPERATOR);
         case '/':
             advance_lexer(lex);
-            return init_token("/", TOKEN_OPERATOR);
+            return init_token(lex->mem, "/", TOKEN_OPERATOR);
         case '=':
             advance_lexer(lex);
             if(lexer_peek(lex) == '=')
             {
                 advance_lexer(lex);
-                return init_token("==", TOKEN_OPERATOR);
+                return init_token(lex->mem, "==", TOKEN_OPERATOR);
             }
             else
             {
-                return init_token("=", TOKEN_OPERATOR);
+                return init_token(lex->mem, "=", TOKEN_OPERATOR);
             }
         case '<':
             advance_lexer(lex);
             if(lexer_peek(lex) == '>')
             {
                 advance_lexer(lex);
-                return init_token("<>", TOKEN_OPERATOR);
+                return init_token(lex->mem, "<>", TOKEN_OPERATOR);
             }
             else if(lexer_peek(lex) == '=')
             {
                 advance_lexer(lex);
-                return init_token("<=", TOKEN_OPERATOR);
+                return init_token(lex->mem, "<=", TOKEN_OPERATOR);
             }
             else
             {
-                return init_token("<", TOKEN_OPERATOR);
+                return init_token(lex->mem, "<", TOKEN_OPERATOR);
             }
         case '>':
             advance_lexer(lex);
             if(lexer_peek(lex) == '=')
             {
                 advance_lexer(lex);
-                return init_token(">=", TOKEN_OPERATOR);
+                return init_token(lex->mem, ">=", TOKEN_OPERATOR);
             }
             else
             {
-                return init_token(">", TOKEN_OPERATOR);
+                return init_token(lex->mem, ">", TOKEN_OPERATOR);
             }
         case '(': 
         case ')':
@@ -160,78 +182,66 @@ token *next_token(lexer *lex)
             
     }
 
-    fprintf(stderr, "ERROR: Unexpected character '%c' at line %d col %d\n",
-            c, lex->line, lex->col);
+    // Reported by the parser, which knows what it expected here.
     advance_lexer(lex);
-    return NULL;
+    char str[2] = { c, 0 };
+    return init_token(lex->mem, arena_strndup(lex->mem, str, 1), TOKEN_ERROR);
+}
+
+static token *scan_token(lexer *lex)
+{
+    skip_whitespace(lex);
+
+    int line = lex->line;
+    int col = lex->col;
+    token *t = lex_token(lex);
+    t->line = line;
+    t->col = col;
+    return t;
 }
 
 // -------------------- Token parsers --------------------
 token *lexer_parse_string(lexer *lex)
 {
     advance_lexer(lex); // skip opening "
-    size_t cap = 16;
-    size_t len = 0;
-    char *buf = malloc(cap);
-    buf[0] = '\0';
+    int start = lex->pos;
 
     while (lexer_peek(lex) != '"' && lexer_peek(lex) != '\0')
-    {
-        if (len+1 >= cap) {
-            cap *= 2;
-            buf = realloc(buf, cap);
-        }
-        buf[len++] = advance_lexer(lex);
-        buf[len] = '\0';
-    }
-    advance_lexer(lex); // skip closing "
-    return init_token(buf, TOKEN_STRING);
+        advance_lexer(lex);
+
+    char *buf = arena_strndup(lex->mem, lex->src + start, lex->pos - start);
+    if (lexer_peek(lex) == '"')
+        advance_lexer(lex); // skip closing "
+    return init_token(lex->mem, buf, TOKEN_STRING);
 }
 
-token *lexer_parse_line_num(lexer *lex)
+// Copy the run of characters accepted by pred starting at the cursor.
+static char *lexer_take(lexer *lex, int (*pred)(int))
 {
-    size_t cap = 16;
-    size_t len = 0;
-    char *buf = malloc(cap);
-
-    while (isdigit(lexer_peek(lex))) {
-        if (len+1 >= cap) buf = realloc(buf, cap*2);
-        buf[len++] = advance_lexer(lex);
-        buf[len] = '\0';
-    }
+    int start = lex->pos;
+
+    while (pred((unsigned char)lexer_peek(lex)))
+        advance_lexer(lex);
 
-    return init_token(buf, TOKEN_LINE_NUM);
+    return arena_strndup(lex->mem, lex->src + start, lex->pos - start);
+}
+
+token *lexer_parse_line_num(lexer *lex)
+{
+    return init_token(lex->mem, lexer_take(lex, isdigit), TOKEN_LINE_NUM);
 }
 
 token *lexer_parse_identifier(lexer *lex)
 {
-    size_t cap = 16;
-    size_t len = 0;
-    char *buf = malloc(cap);
-
-    while (isalnum(lexer_peek(lex))) {
-        if (len+1 >= cap) buf = realloc(buf, cap*2);
-        buf[len++] = advance_lexer(lex);
-        buf[len] = '\0';
-    }
+    char *buf = lexer_take(lex, isalnum);
 
-    if (is_keyword(buf)) return init_token(buf, TOKEN_KEYWORD);
-    return init_token(buf, TOKEN_IDENTIFIER);
+    if (is_keyword(buf)) return init_token(lex->mem, buf, TOKEN_KEYWORD);
+    return init_token(lex->mem, buf, TOKEN_IDENTIFIER);
 }
 
 token *lexer_parse_number(lexer *lex)
 {
-    size_t cap = 16;
-    size_t len = 0;
-    char *buf = malloc(cap);
-
-    while (isdigit(lexer_peek(lex))) {
-        if (len+1 >= cap) buf = realloc(buf, cap*2);
-        buf[len++] = advance_lexer(lex);
-        buf[len] = '\0';
-    }
-
-    return init_token(buf, TOKEN_NUMBER);
+    return init_token(lex->mem, lexer_take(lex, isdigit), TOKEN_NUMBER);
 }
 
 
@@ -240,11 +250,11 @@ token *lexer_parse_punctuation(lexer *lex)
 {
     char p = advance_lexer(lex);
     char str[2] = { p, 0 };
-    return init_token(strdup(str), TOKEN_PUNCTUATION);
+    return init_token(lex->mem, arena_strndup(lex->mem, str, 1), TOKEN_PUNCTUATION);
 }
 
 token *lexer_parse_end_of_line(lexer *lex)
 {
     advance_lexer(lex);
-    return init_token(NULL, TOKEN_EOL);
+    return init_token(lex->mem, NULL, TOKEN_EOL);
 }
@@ -1,14 +1,264 @@
 #include "stdio.h"
-#include "lex.h"
-#include "token.h"
-#include "parse.h"
+#include "tinybasic.h"
+#include "ir.h"
+#include "vm.h"
+#include "rtio.h"
+#include "server.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "batch.h"
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+// Instructions between checks for a SIGUSR1 snapshot request.
+#define SNAPSHOT_SLICE (1L << 20)
 
-int main()
+static volatile sig_atomic_t snapshot_requested;
+
+static void on_sigusr1(int sig)
+{
+    (void)sig;
+    snapshot_requested = 1;
+}
+
+// Run to the end, or until the break point or a SIGUSR1 asks for a
+// snapshot; then the state is saved and the run stops with VM_BREAK.
+static enum vm_status run_with_snapshot(vm *m, const char *snapshot_path)
+{
+    if (!snapshot_path)
+        return vm_run(m);
+
+    for (;;) {
+        enum vm_status st = vm_run_slice(m, SNAPSHOT_SLICE);
+        if (st == VM_YIELD && !snapshot_requested)
+            continue;
+        if (st != VM_YIELD && st != VM_BREAK)
+            return st;
+
+        snapshot_requested = 0;
+        int line = m->pc < m->ir->count ? m->ir->code[m->pc].line : 0;
+        if (save_snapshot(m, snapshot_path) != 0) {
+            m->error = "snapshot not written";
+            m->error_line = line;
+            return VM_ERROR;
+        }
+        fprintf(stderr, "snapshot of line %d written to %s\n", line, snapshot_path);
+        return VM_BREAK;
+    }
+}
+
+// Continue a program from a snapshot; no source is read.
+static int run_restored(const char *restore_path, const char *snapshot_path,
+                        const char *input_path)
+{
+    rt_input *in = input_path ? init_rt_input_file(input_path) : init_rt_input_stdin();
+    if (!in)
+        return 1;
+
+    rt_output *out = init_rt_output(1, RT_OUTPUT_CAP);
+    snapshot *s = load_snapshot(restore_path, out, in);
+    int status = 1;
+    if (s) {
+        status = 0;
+        if (run_with_snapshot(s->m, snapshot_path) == VM_ERROR) {
+            rt_flush(out);
+            fprintf(stderr, "Runtime error at line %d: %s\n", s->m->error_line, s->m->error);
+            status = 1;
+        }
+        rt_flush(out);
+        free_snapshot(s);
+    }
+    free_rt_output(out);
+    free_rt_input(in);
+    return status;
+}
+
+// Run the program once per line of inputs_path, BATCH_WIDTH lines at a
+// time, and print every run's output under a header of its own.
+static int run_batch(ir_program *ir, const char *inputs_path, int cold_start, long budget, int simd)
+{
+    rt_input **sets;
+    int n = rt_read_input_sets(inputs_path, &sets);
+    if (n < 0)
+        return 1;
+
+    struct timespec t0, t1;
+    batch *b = init_batch(ir, sets, n);
+    free(sets);
+    b->cold_start = cold_start;
+    if (budget > 0)
+        b->budget = budget;
+    b->simd &= simd;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    batch_run(b);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int status = 0;
+    for (int i = 0; i < b->nlanes; i++) {
+        batch_lane *l = &b->lanes[i];
+        printf("%s==> input %d <==\n", i ? "\n" : "", i + 1);
+        fwrite(l->out->buf, 1, l->out->len, stdout);
+        if (l->status == VM_ERROR) {
+            fflush(stdout);
+            fprintf(stderr, "input %d: runtime error at line %d: %s\n", i + 1, l->error_line, l->error);
+            status = 1;
+        }
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "ran %d inputs in %.3f s\n", b->nlanes,
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    fprint_batch_stats(stderr, b);
+    free_batch(b);
+    return status;
+}
+
+// Run many copies of the program under the scheduler. Each copy is fed
+// the replay file up front and the first copy's output is printed.
+static int run_tasks(ir_program *ir, int ntasks, int workers, long budget,
+                     int cold_start, const char *input_path, const char *stats_path)
 {
-    FILE* fp = fopen("test/ticTakToe.bss", "rb");
+    rt_input *values = input_path ? init_rt_input_file(input_path) : NULL;
+    if (input_path && !values)
+        return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    sched *s = init_sched(workers, budget);
+    for (int i = 0; i < ntasks; i++) {
+        sched_task *t = sched_spawn(s, ir, cold_start);
+        if (values && values->count)
+            sched_feed(s, t, values->values, values->count);
+    }
+    sched_wait(s);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    sched_task *first = s->tasks[0];
+    fwrite(first->out->buf, 1, first->out->len, stdout);
+    fflush(stdout);
+    if (first->m->status == VM_ERROR)
+        fprintf(stderr, "Runtime error at line %d: %s\n", first->m->error_line, first->m->error);
+
+    fprintf(stderr, "ran %d tasks on %d workers in %.3f s, budget %ld instructions\n",
+            s->ntasks, s->nworkers,
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, s->budget);
+    fprint_sched_stats(stderr, s);
+    if (stats_path) {
+        FILE *fp = fopen(stats_path, "w");
+        if (fp) {
+            fprint_sched_tasks(fp, s);
+            fclose(fp);
+        } else {
+            perror(stats_path);
+        }
+    }
+
+    int status = first->m->status == VM_ERROR;
+    free_sched(s);
+    free_rt_input(values);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "test/ticTakToe.bss";
+    const char *input_path = NULL;
+    const char *socket_path = NULL;
+    const char *stacks_path = NULL;
+    const char *snapshot_path = NULL;
+    const char *restore_path = NULL;
+    int snapshot_line = -1;
+    int workers = 0;
+    int dump_ir = 0;
+    int optimize = 0;
+    int run = 0;
+    int keep_going = 0;
+    long repeat = 1;
+    int cold_start = VM_COLD_START;
+    int tasks = 0;
+    const char *task_stats_path = NULL;
+    const char *batch_path = NULL;
+    int simd = 1;
+    long budget = 0;
+    int profiling = 0;
+    int profile_hz = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ir") == 0)
+            dump_ir = 1;
+        else if (strcmp(argv[i], "-O") == 0)
+            optimize = 1;
+        else if (strcmp(argv[i], "--run") == 0)
+            run = 1;
+        else if (strcmp(argv[i], "--keep-going") == 0)
+            keep_going = 1;
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            input_path = argv[++i];
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = atol(argv[++i]);
+        else if (strcmp(argv[i], "--cold-start") == 0 && i + 1 < argc)
+            cold_start = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--tasks") == 0 && i + 1 < argc) {
+            tasks = atoi(argv[++i]);
+            run = 1;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_path = argv[++i];
+            run = 1;
+        }
+        else if (strcmp(argv[i], "--no-simd") == 0)
+            simd = 0;
+        else if (strcmp(argv[i], "--task-stats") == 0 && i + 1 < argc)
+            task_stats_path = argv[++i];
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+            budget = atol(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0)
+            profiling = run = 1;
+        else if (strcmp(argv[i], "--profile-hz") == 0 && i + 1 < argc) {
+            profile_hz = atoi(argv[++i]);
+            profiling = run = 1;
+        }
+        else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc) {
+            stacks_path = argv[++i];
+            profiling = run = 1;
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+            run = 1;
+        }
+        else if (strcmp(argv[i], "--snapshot-at") == 0 && i + 1 < argc)
+            snapshot_line = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+            restore_path = argv[++i];
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else
+            path = argv[i];
+    }
+
+    if (socket_path)
+        return tb_serve(socket_path, workers);
+
+    if (snapshot_path && snapshot_line < 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sigusr1;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+
+    if (restore_path)
+        return run_restored(restore_path, snapshot_path, input_path);
+
+    FILE* fp = fopen(path, "rb");
 
 
     if (!fp) {
@@ -53,15 +303,99 @@ int main()
 
     fclose(fp);
 
-    lexer *lex = init_lexer(buffer);
-    // token* tok;
-    // do{
-    //     tok = next_token(lex);
-    //     printf("%s\n", type_to_string(tok->type));
-    // }while(tok->type != TOKEN_EOF);
-
-    ast* n = parse(lex);
-    print_ast(n, 3);
-    
-    return 0;
+    tb_context *ctx = tb_init();
+    ast* n = tb_parse(ctx, buffer, filesize);
+    free(buffer);
+
+    // Lines with errors are left out of the program; report them all.
+    int errors = tb_diagnostic_count(ctx);
+    tb_fprint_diagnostics(stderr, ctx, path);
+
+    if (!dump_ir && !run) {
+        print_ast(n, 3);
+        tb_free(ctx);
+        return errors ? 1 : 0;
+    }
+
+    if (errors && !keep_going) {
+        tb_free(ctx);
+        return 1;
+    }
+
+    ir_program *ir = ir_lower(n);
+    if (optimize)
+        ir_optimize(ir, stderr);
+    if (dump_ir)
+        print_ir(ir);
+
+    int status = 0;
+    if (run && batch_path) {
+        status = run_batch(ir, batch_path, cold_start, budget, simd);
+    } else if (run && tasks > 0) {
+        status = run_tasks(ir, tasks, workers, budget, cold_start, input_path, task_stats_path);
+    } else if (run) {
+        // a missing line would never break, so the run would go unsaved
+        int break_pc = -1;
+        if (snapshot_path && snapshot_line >= 0) {
+            break_pc = ir_find_line(ir, snapshot_line);
+            if (break_pc < 0) {
+                fprintf(stderr, "--snapshot-at: no line %d\n", snapshot_line);
+                free_ir_program(ir);
+                tb_free(ctx);
+                return 1;
+            }
+        }
+
+        rt_input *in = input_path ? init_rt_input_file(input_path) : init_rt_input_stdin();
+        if (!in)
+            return 1;
+
+        rt_output *out = init_rt_output(1, RT_OUTPUT_CAP);
+        vm *m = init_vm(ir, out, in);
+        m->cold_start = cold_start;
+        m->break_pc = break_pc;
+
+        profile *prof = NULL;
+        if (profiling) {
+            prof = init_profile(ir, profile_hz > 0 ? PROFILE_SAMPLE : PROFILE_COUNT, profile_hz);
+            m->prof = prof;
+            profile_start(prof);
+        }
+
+        // With a replay file the same session can be run many times over.
+        for (long r = 0; r < repeat && status == 0; r++) {
+            vm_reset(m);
+            rt_input_rewind(in);
+            enum vm_status st = run_with_snapshot(m, snapshot_path);
+            if (st == VM_BREAK)
+                break;
+            if (st == VM_ERROR) {
+                rt_flush(out);
+                fprintf(stderr, "Runtime error at line %d: %s\n", m->error_line, m->error);
+                status = 1;
+            }
+        }
+
+        if (prof) {
+            profile_stop(prof);
+            rt_flush(out);
+            fprint_profile_listing(stderr, prof, ctx->src);
+            FILE *fp = stacks_path ? fopen(stacks_path, "w") : NULL;
+            if (fp) {
+                fprint_profile_stacks(fp, prof);
+                fclose(fp);
+            } else if (stacks_path) {
+                perror(stacks_path);
+            }
+            free_profile(prof);
+        }
+
+        free_vm(m);
+        free_rt_output(out);
+        free_rt_input(in);
+    }
+    free_ir_program(ir);
+    tb_free(ctx);
+
+    return status;
 }
\ No newline at end of file
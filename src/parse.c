@@ -1,58 +1,230 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
 
 #include "parse.h"
 #include "lex.h"
 #include "token.h"
 #include "ast.h"
 
-// ---------------- Helper functions ----------------
-static token *peek(lexer *lex) { return lexer_peek_next_token(lex); }
-static token *next(lexer *lex) { return next_token(lex); }
+// ---------------- Parser state / diagnostics ----------------
+parser *init_parser(lexer *lex)
+{
+    parser *p = arena_alloc(lex->mem, sizeof(parser));
+    p->lex = lex;
+    p->mem = lex->mem;
+    p->basic_line = -1;
+    p->last_line = -1;
+    return p;
+}
 
-static token *expect(lexer *lex, int type)
+static const char *describe(int type)
 {
-    token *t = next(lex);
-    if (!t || t->type != type)
+    switch (type)
     {
-        fprintf(stderr, "Parse error: expected token type %d, got %d\n",
-                type, t ? t->type : -1);
-        printf("line: %d, col: %d\n", lex->line, lex->col);
-        exit(1);
+        case TOKEN_LINE_NUM: return "line number";
+        case TOKEN_KEYWORD: return "keyword";
+        case TOKEN_IDENTIFIER: return "variable";
+        case TOKEN_NUMBER: return "number";
+        case TOKEN_OPERATOR: return "operator";
+        case TOKEN_PUNCTUATION: return "punctuation";
+        case TOKEN_STRING: return "string";
+        case TOKEN_EOL: return "end of line";
+        case TOKEN_EOF: return "end of input";
+        case TOKEN_ERROR: return "invalid character";
+        default: return "token";
     }
+}
+
+// Record a diagnostic at token t and unwind to the line-level recovery
+// point in parse().
+static void parse_error(parser *p, int expected, token *t, const char *fmt, ...)
+{
+    if (p->ndiags == p->diagcap)
+    {
+        p->diagcap = p->diagcap ? p->diagcap * 2 : 8;
+        diagnostic *grown = arena_alloc(p->mem, p->diagcap * sizeof(diagnostic));
+        if (p->ndiags)
+            memcpy(grown, p->diags, p->ndiags * sizeof(diagnostic));
+        if (!p->mem)
+            free(p->diags);
+        p->diags = grown;
+    }
+
+    char msg[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    diagnostic *d = &p->diags[p->ndiags++];
+    d->line = t->line;
+    d->col = t->col;
+    d->basic_line = p->basic_line;
+    d->expected = expected;
+    d->got = t->type;
+    d->got_value = t->value;
+    d->message = arena_strndup(p->mem, msg, strlen(msg));
+
+    longjmp(p->recover, 1);
+}
+
+// Count one more expression level; t is blamed when there are too many.
+static void enter(parser *p, token *t)
+{
+    if (++p->depth > PARSE_MAX_DEPTH)
+        parse_error(p, -1, t, "expression nested more than %d levels deep", PARSE_MAX_DEPTH);
+}
+
+void fprint_diagnostic(FILE *out, const char *filename, diagnostic *d)
+{
+    fprintf(out, "%s:%d:%d: error: %s", filename, d->line, d->col + 1, d->message);
+    if (d->basic_line >= 0)
+        fprintf(out, " (in BASIC line %d)", d->basic_line);
+    fprintf(out, "\n");
+}
+
+// ---------------- Helper functions ----------------
+static token *peek(parser *p) { return lexer_peek_next_token(p->lex); }
+static token *next(parser *p) { return next_token(p->lex); }
+
+static const char *token_text(token *t)
+{
+    if (t->type == TOKEN_EOL || t->type == TOKEN_EOF || !t->value)
+        return describe(t->type);
+    return t->value;
+}
+
+static token *expect(parser *p, int type)
+{
+    token *t = next(p);
+    if (t->type != type)
+        parse_error(p, type, t, "expected %s, got '%s'", describe(type), token_text(t));
     return t;
 }
 
+// Variables are the single letters A..Z.
+static token *expect_var(parser *p)
+{
+    token *t = expect(p, TOKEN_IDENTIFIER);
+    if (strlen(t->value) != 1)
+        parse_error(p, TOKEN_IDENTIFIER, t, "'%s' is not a variable name (A-Z)", t->value);
+    return t;
+}
+
+static int is_relop(token *t)
+{
+    static const char *relops[] = { "=", "==", "<>", "<", ">", "<=", ">=", NULL };
+
+    if (t->type != TOKEN_OPERATOR)
+        return 0;
+    for (int i = 0; relops[i]; i++)
+        if (strcmp(t->value, relops[i]) == 0)
+            return 1;
+    return 0;
+}
+
+// Skip the remainder of a line that failed to parse.
+static void synchronize(parser *p)
+{
+    while (peek(p)->type != TOKEN_EOL && peek(p)->type != TOKEN_EOF)
+        next(p);
+}
+
 static int is_keyword(token *t, const char *kw)
 {
     return t && t->type == TOKEN_KEYWORD && strcasecmp(t->value, kw) == 0;
 }
 
+static int is_punctuation(token *t, const char *p)
+{
+    return t && t->type == TOKEN_PUNCTUATION && strcmp(t->value, p) == 0;
+}
+
+static int at_end_of_line(token *t)
+{
+    return !t || t->type == TOKEN_EOL || t->type == TOKEN_EOF;
+}
+
+// Consume GO followed by the given keyword, as in GO TO or GO SUB.
+static void expect_go(parser *p, const char *kw)
+{
+    token *t = next(p);
+    if (is_keyword(t, "GO"))
+    {
+        t = next(p);
+        if (!is_keyword(t, kw))
+            parse_error(p, TOKEN_KEYWORD, t, "expected %s after GO, got '%s'", kw, token_text(t));
+    }
+}
+
+// A constant line number is kept in tok; a computed one becomes a child.
+static ast *parse_jump_target(parser *p, ast *node)
+{
+    ast *target = parse_expression(p);
+
+    if (target->type == EXPRESSION && !target->child &&
+        target->tok->type == TOKEN_NUMBER)
+        node->tok = target->tok;
+    else
+        ast_add_child(node, target);
+
+    return node;
+}
+
 // program     ::= { line }
-ast *parse(lexer *lex)
+ast *parse(parser *p)
 {
-    ast *prog = init_node(PROGRAM, NULL);
-    while (peek(lex)->type != TOKEN_EOF)
+    ast *prog = init_node(p->mem, PROGRAM, NULL);
+    while (peek(p)->type != TOKEN_EOF)
     {
-        ast_add_child(prog, parse_line(lex));
+        // blank lines
+        if (peek(p)->type == TOKEN_EOL)
+        {
+            next(p);
+            continue;
+        }
+
+        p->depth = 0;
+        if (setjmp(p->recover) == 0)
+        {
+            ast *line = parse_line(p);
+
+            token *t = peek(p);
+            if (!at_end_of_line(t))
+                parse_error(p, TOKEN_EOL, t, "unexpected '%s' after statement", token_text(t));
+
+            ast_add_child(prog, line);
+            p->last_line = p->basic_line;
+        }
+        else
+        {
+            synchronize(p);
+        }
 
         // consume EOL after each line
-        token *t = peek(lex);
-        if (t && t->type == TOKEN_EOL)
-            next(lex);
+        token *t = peek(p);
+        if (t->type == TOKEN_EOL)
+            next(p);
     }
 
     return prog;
 }
 
 // line        ::= number statement
-ast *parse_line(lexer *lex)
+ast *parse_line(parser *p)
 {
-    token *lineNum = expect(lex, TOKEN_LINE_NUM);
-    ast *lineNode = init_node(LINE, lineNum);
-
-    ast *stmt = parse_statement(lex);
+    token *lineNum = expect(p, TOKEN_LINE_NUM);
+    p->basic_line = atoi(lineNum->value);
+    if (p->basic_line == p->last_line)
+        parse_error(p, -1, lineNum, "duplicate line number %d", p->basic_line);
+    if (p->basic_line < p->last_line)
+        parse_error(p, -1, lineNum, "line %d comes after line %d", p->basic_line, p->last_line);
+    ast *lineNode = init_node(p->mem, LINE, lineNum);
+
+    ast *stmt = parse_statement(p);
     ast_add_child(lineNode, stmt);
     return lineNode;
 }
@@ -68,250 +240,305 @@ statement   ::= let-stmt
               | end-stmt
               | rem-stmt
 */
-ast *parse_statement(lexer *lex)
+ast *parse_statement(parser *p)
 {
-    token *t = peek(lex);
-
-    if (!t)
-    {
-        fprintf(stderr, "Unexpected end of input\n");
-        exit(1);
-    }
+    token *t = peek(p);
 
     if (t->type == TOKEN_KEYWORD)
     {
         if (is_keyword(t, "LET"))
-            return parse_let(lex);
+            return parse_let(p);
         if (is_keyword(t, "PRINT"))
-            return parse_print(lex);
+            return parse_print(p);
         if (is_keyword(t, "INPUT"))
-            return parse_input(lex);
+            return parse_input(p);
         if (is_keyword(t, "GOTO"))
-            return parse_goto(lex);
+            return parse_goto(p);
+        if (is_keyword(t, "GO"))
+        {
+            lexer temp = *p->lex;
+            next_token(&temp);
+            if (is_keyword(next_token(&temp), "SUB"))
+                return parse_gosub(p);
+            return parse_goto(p);
+        }
         if (is_keyword(t, "IF"))
-            return parse_if(lex);
+            return parse_if(p);
         if (is_keyword(t, "GOSUB"))
-            return parse_gosub(lex);
+            return parse_gosub(p);
         if (is_keyword(t, "RETURN"))
-            return parse_return_stmt(lex);
+            return parse_return_stmt(p);
         if (is_keyword(t, "END"))
-            return parse_end_stmt(lex);
+            return parse_end_stmt(p);
         if (is_keyword(t, "REM"))
-            return parse_rem_stmt(lex);
+            return parse_rem_stmt(p);
     }
 
     if (t->type == TOKEN_IDENTIFIER)
-        return parse_let(lex);
+        return parse_let(p);
 
-    fprintf(stderr, "Unknown statement token '%s'\n", t->value);
-    exit(1);
+    parse_error(p, -1, t, "expected a statement, got '%s'", token_text(t));
+    return NULL;
 }
 
 
 // let-stmt    ::= (LET)? var '=' expr
-ast *parse_let(lexer *lex)
+ast *parse_let(parser *p)
 {
-    if (is_keyword(peek(lex), "LET"))
-        next(lex);
+    if (is_keyword(peek(p), "LET"))
+        next(p);
 
-    token *var = expect(lex, TOKEN_IDENTIFIER);
+    token *var = expect_var(p);
 
-    token *eq = expect(lex, TOKEN_OPERATOR);
-    if (strcmp(eq->value, "=") != 0) {
-        fprintf(stderr, "Expected '=' in LET statement\n");
-        exit(1);
-    }
+    token *eq = next(p);
+    if (eq->type != TOKEN_OPERATOR || strcmp(eq->value, "=") != 0)
+        parse_error(p, TOKEN_OPERATOR, eq, "expected '=' in LET statement, got '%s'", token_text(eq));
 
-    ast *exprNode = parse_expression(lex);
+    ast *exprNode = parse_expression(p);
 
-    ast *node = init_node(LET_STATEMENT, NULL);
-    ast* eq_node = init_node(EXPRESSION, eq);
+    ast *node = init_node(p->mem, LET_STATEMENT, NULL);
+    ast* eq_node = init_node(p->mem, EXPRESSION, eq);
     ast_add_child(node, eq_node);   // '=' operator node
-    ast_add_child(eq_node, init_node(EXPRESSION, var));  // var
+    ast_add_child(eq_node, init_node(p->mem, EXPRESSION, var));  // var
     ast_add_child(eq_node, exprNode);                    // RHS expression
 
     return node;
 }
 
 
-// print-stmt  ::= PRINT print-list
-ast *parse_print(lexer *lex)
+// print-stmt  ::= PRINT [ print-list ]
+// print-item  ::= string | expr
+ast *parse_print(parser *p)
 {
-    next(lex); // consume PRINT
-    ast *node = init_node(PRINT_STATEMENT, NULL);
+    next(p); // consume PRINT
+    ast *node = init_node(p->mem, PRINT_STATEMENT, NULL);
 
+    while (!at_end_of_line(peek(p)))
+    {
+        // a string is only ever a whole print item
+        if (peek(p)->type == TOKEN_STRING) {
+            ast_add_child(node, init_node(p->mem, STRING_LITERAL, next(p)));
+            if (peek(p)->type == TOKEN_OPERATOR)
+                parse_error(p, -1, peek(p), "a string cannot be used in an expression");
+        } else {
+            ast_add_child(node, parse_expression(p));
+        }
 
-   ast_add_child(node, parse_expression(lex));
+        token *sep = peek(p);
+        if (!is_punctuation(sep, ",") && !is_punctuation(sep, ";"))
+            break;
 
-    while (peek(lex)->type == TOKEN_PUNCTUATION &&
-           (strcmp(peek(lex)->value, ",") == 0 ||
-            strcmp(peek(lex)->value, ";") == 0))
-    {
-        next(lex); // consume separator
-        ast_add_child(node, parse_expression(lex));
+        next(p); // consume separator
+        ast_add_child(node, init_node(p->mem, PRINT_SEPARATOR, sep));
     }
 
     return node;
 }
 
 // ---------------- INPUT statement ----------------
-ast *parse_input(lexer *lex)
+ast *parse_input(parser *p)
 {
-    next(lex);
-    token *id = expect(lex, TOKEN_IDENTIFIER);
-    return init_node(INPUT_STATEMENT, id);
+    next(p);
+    token *id = expect_var(p);
+    return init_node(p->mem, INPUT_STATEMENT, id);
 }
 
-// ---------------- GOTO statement ----------------
-ast *parse_goto(lexer *lex)
+// goto-stmt   ::= (GOTO | GO TO) expr
+ast *parse_goto(parser *p)
 {
-    next(lex);
-    token *num = expect(lex, TOKEN_NUMBER);
-    return init_node(GO_TO_STATEMENT, num);
+    expect_go(p, "TO");
+    return parse_jump_target(p, init_node(p->mem, GO_TO_STATEMENT, NULL));
 }
 
-// if-stmt     ::= IF expr relop expr THEN number
-ast *parse_if(lexer *lex)
+// if-stmt     ::= IF expr relop expr [THEN] (number | statement)
+ast *parse_if(parser *p)
 {
-    next(lex); // consume IF
-    ast *node = init_node(IF_STATEMENT, NULL);
-    ast* expr_left = parse_expression(lex);
-    
-
-    token *op = expect(lex, TOKEN_OPERATOR);
-    ast* relop = init_node(EXPRESSION, op);
-    ast* expr_right = parse_expression(lex);
+    next(p); // consume IF
+    ast *node = init_node(p->mem, IF_STATEMENT, NULL);
+    ast* expr_left = parse_expression(p);
     
 
-
-    token *thenTok = expect(lex, TOKEN_KEYWORD);
-    if (!is_keyword(thenTok, "THEN"))
-    {
-        fprintf(stderr, "Expected THEN in IF statement\n");
-        exit(1);
-    }
-
-    token *num = expect(lex, TOKEN_NUMBER);
+    token *op = next(p);
+    if (!is_relop(op))
+        parse_error(p, TOKEN_OPERATOR, op, "expected a relational operator, got '%s'", token_text(op));
+    ast* relop = init_node(p->mem, EXPRESSION, op);
+    ast* expr_right = parse_expression(p);
     ast_add_child(node, relop);
     ast_add_child(relop, expr_left);
     ast_add_child(relop, expr_right);
-    ast_add_child(node, init_node(EXPRESSION, num));
+
+    if (is_keyword(peek(p), "THEN"))
+        next(p);
+
+    if (peek(p)->type == TOKEN_NUMBER)
+        ast_add_child(node, init_node(p->mem, EXPRESSION, next(p)));
+    else
+        ast_add_child(node, parse_statement(p));
+
     return node;
 }
 
-// ---------------- GOSUB statement ----------------
-ast *parse_gosub(lexer *lex)
+// gosub-stmt  ::= (GOSUB | GO SUB) expr
+ast *parse_gosub(parser *p)
 {
-    next(lex);
-    token *num = expect(lex, TOKEN_NUMBER);
-    return init_node(GO_SUB_STATEMENT, num);
+    expect_go(p, "SUB");
+    return parse_jump_target(p, init_node(p->mem, GO_SUB_STATEMENT, NULL));
 }
 
 // ---------------- RETURN statement ----------------
-ast *parse_return_stmt(lexer *lex)
+ast *parse_return_stmt(parser *p)
 {
-    next(lex);
-    return init_node(RETURN_STATEMENT, NULL);
+    next(p);
+    return init_node(p->mem, RETURN_STATEMENT, NULL);
 }
 
 // ---------------- END statement ----------------
-ast *parse_end_stmt(lexer *lex)
+ast *parse_end_stmt(parser *p)
 {
-    next(lex);
-    return init_node(END_STATEMENT, NULL);
+    next(p);
+    return init_node(p->mem, END_STATEMENT, NULL);
 }
 
 // ---------------- REM statement ----------------
-ast *parse_rem_stmt(lexer *lex)
+ast *parse_rem_stmt(parser *p)
 {
-    token *rem = next(lex); // consume REM
-    ast *node = init_node(STRING_LITERAL, rem);
+    token *rem = next(p); // consume REM
+    ast *node = init_node(p->mem, STRING_LITERAL, rem);
 
     // consume rest of line as string tokens until EOL
-    while (peek(lex)->type != TOKEN_EOL && peek(lex)->type != TOKEN_EOF)
-        next(lex);
+    while (peek(p)->type != TOKEN_EOL && peek(p)->type != TOKEN_EOF)
+        next(p);
 
     return node;
 }
 
 // ---------------- Expression parser ----------------
-ast *parse_expression(lexer *lex)
+ast *parse_expression(parser *p)
 {
-    ast *left = parse_term(lex);
+    int depth = p->depth;
+    ast *left = parse_term(p);
 
-    while (peek(lex)->type == TOKEN_OPERATOR &&
-           (strcmp(peek(lex)->value, "+") == 0 ||
-            strcmp(peek(lex)->value, "-") == 0))
+    while (peek(p)->type == TOKEN_OPERATOR &&
+           (strcmp(peek(p)->value, "+") == 0 ||
+            strcmp(peek(p)->value, "-") == 0))
     {
-        token *op = next(lex);
-        ast *right = parse_term(lex);
+        token *op = next(p);
+        enter(p, op); // left grows one level
+        ast *right = parse_term(p);
 
-        ast *node = init_node(EXPRESSION, op);
+        ast *node = init_node(p->mem, EXPRESSION, op);
         ast_add_child(node, left);
         ast_add_child(node, right);
 
         left = node;
     }
 
+    p->depth = depth;
     return left;
 }
 
 
-ast *parse_term(lexer *lex)
+ast *parse_term(parser *p)
 {
-    ast *left = parse_factor(lex);
+    int depth = p->depth;
+    ast *left = parse_factor(p);
 
-    while (peek(lex)->type == TOKEN_OPERATOR &&
-           (strcmp(peek(lex)->value, "*") == 0 ||
-            strcmp(peek(lex)->value, "/") == 0))
+    while (peek(p)->type == TOKEN_OPERATOR &&
+           (strcmp(peek(p)->value, "*") == 0 ||
+            strcmp(peek(p)->value, "/") == 0))
     {
-        token *op = next(lex);
-        ast *right = parse_factor(lex);
+        token *op = next(p);
+        enter(p, op); // left grows one level
+        ast *right = parse_factor(p);
 
-        ast *node = init_node(EXPRESSION, op);
+        ast *node = init_node(p->mem, EXPRESSION, op);
         ast_add_child(node, left);
         ast_add_child(node, right);
+
+        left = node;
     }
 
+    p->depth = depth;
     return left;
 }
 
-ast *parse_factor(lexer *lex)
+static ast *parse_operand(parser *p, token *t);
+
+ast *parse_factor(parser *p)
+{
+    token *t = peek(p);
+    enter(p, t);
+    ast *node = parse_operand(p, t);
+    p->depth--;
+    return node;
+}
+
+static ast *parse_operand(parser *p, token *t)
 {
-    token *t = peek(lex);
 
-    if (!t)
+    if (t->type == TOKEN_NUMBER)
     {
-        fprintf(stderr, "Unexpected end of input in factor\n");
-        exit(1);
+        next(p);
+        return init_node(p->mem, EXPRESSION, t);
     }
 
-    if (t->type == TOKEN_NUMBER || t->type == TOKEN_IDENTIFIER)
+    if (t->type == TOKEN_IDENTIFIER)
+        return init_node(p->mem, EXPRESSION, expect_var(p));
+
+    // unary sign: a '-' node with a single operand
+    if (t->type == TOKEN_OPERATOR &&
+        (strcmp(t->value, "-") == 0 || strcmp(t->value, "+") == 0))
     {
-        next(lex);
-        return init_node(EXPRESSION, t);
+        next(p);
+        ast *operand = parse_factor(p);
+        if (strcmp(t->value, "+") == 0)
+            return operand;
+
+        ast *node = init_node(p->mem, EXPRESSION, t);
+        ast_add_child(node, operand);
+        return node;
     }
 
     if (t->type == TOKEN_STRING)
-    {
-        next(lex);
-        return init_node(STRING_LITERAL, t);
-    }
+        parse_error(p, -1, t, "a string cannot be used in an expression");
+
+    if (is_keyword(t, "USR"))
+        return parse_usr(p);
 
     if (t->type == TOKEN_PUNCTUATION && strcmp(t->value, "(") == 0)
     {
-        next(lex); // consume '('
-        ast *e = parse_expression(lex);
-        token *rp = expect(lex, TOKEN_PUNCTUATION);
-        if (strcmp(rp->value, ")") != 0)
-        {
-            fprintf(stderr, "Expected ')'\n");
-            exit(1);
-        }
+        next(p); // consume '('
+        ast *e = parse_expression(p);
+        token *rp = next(p);
+        if (!is_punctuation(rp, ")"))
+            parse_error(p, TOKEN_PUNCTUATION, rp, "expected ')', got '%s'", token_text(rp));
         return e;
     }
 
-    fprintf(stderr, "Unexpected token '%s' in factor\n", t->value);
-    printf("line: %d, col: %d\n", lex->line, lex->col);
-    exit(1);
+    parse_error(p, -1, t, "expected an expression, got '%s'", token_text(t));
+    return NULL;
+}
+
+// USR(address [, x [, y]]) calls a machine routine; the arguments are
+// the children in order.
+ast *parse_usr(parser *p)
+{
+    ast *node = init_node(p->mem, USR_CALL, next(p));
+
+    token *lp = next(p);
+    if (!is_punctuation(lp, "("))
+        parse_error(p, TOKEN_PUNCTUATION, lp, "expected '(' after USR, got '%s'", token_text(lp));
+
+    int nargs = 0;
+    for (;;) {
+        ast_add_child(node, parse_expression(p));
+        nargs++;
+
+        token *t = next(p);
+        if (is_punctuation(t, ")"))
+            break;
+        if (!is_punctuation(t, ",") || nargs == 3)
+            parse_error(p, TOKEN_PUNCTUATION, t, "expected ')' after USR arguments, got '%s'", token_text(t));
+    }
+    return node;
 }
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "profile.h"
+#include "ir.h"
+
+volatile sig_atomic_t profile_tick;
+
+static struct sigaction saved_sigprof;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void on_sigprof(int sig)
+{
+    (void)sig;
+    profile_tick = 1;
+}
+
+// Instructions outside any line are charged to the extra slot nslots.
+profile *init_profile(ir_program *ir, enum profile_mode mode, int hz)
+{
+    profile *p = calloc(1, sizeof(profile));
+    p->ir = ir;
+    p->mode = mode;
+    p->hz = hz > 0 ? hz : PROFILE_DEFAULT_HZ;
+    p->nslots = ir->nlines;
+
+    p->slot = malloc((ir->count + 1) * sizeof(int));
+    p->entry = calloc(ir->count + 1, 1);
+    for (int pc = 0; pc < ir->count; pc++) {
+        int s = ir_line_slot(ir, ir->code[pc].line);
+        p->slot[pc] = s < 0 ? p->nslots : s;
+        p->entry[pc] = s >= 0 && ir->lines[s].index == pc;
+    }
+
+    p->hits = calloc(p->nslots + 1, sizeof(uint64_t));
+    p->weight = calloc(p->nslots + 1, sizeof(uint64_t));
+    p->calls = calloc(p->nslots + 1, sizeof(uint64_t));
+
+    p->nodecap = 16;
+    p->nodes = malloc(p->nodecap * sizeof(profile_node));
+    p->nodes[0] = (profile_node){ .parent = -1, .slot = -1, .child = -1, .sibling = -1 };
+    p->nnodes = 1;
+    p->cur = -1;
+    return p;
+}
+
+void free_profile(profile *p)
+{
+    if (!p)
+        return;
+
+    for (int i = 0; i < p->nnodes; i++)
+        free(p->nodes[i].weight);
+    free(p->nodes);
+    free(p->slot);
+    free(p->entry);
+    free(p->hits);
+    free(p->weight);
+    free(p->calls);
+    free(p);
+}
+
+static void charge(profile *p, int slot, uint64_t w)
+{
+    profile_node *n = &p->nodes[p->node];
+    if (!n->weight)
+        n->weight = calloc(p->nslots + 1, sizeof(uint64_t));
+    n->weight[slot] += w;
+    p->weight[slot] += w;
+    p->total += w;
+}
+
+// Charge the running line up to now.
+static void flush(profile *p)
+{
+    if (p->mode != PROFILE_COUNT)
+        return;
+
+    uint64_t now = now_ns();
+    if (p->cur >= 0)
+        charge(p, p->cur, now - p->last);
+    p->last = now;
+}
+
+static int child_node(profile *p, int parent, int slot)
+{
+    for (int c = p->nodes[parent].child; c >= 0; c = p->nodes[c].sibling)
+        if (p->nodes[c].slot == slot)
+            return c;
+
+    if (p->nnodes == p->nodecap) {
+        p->nodecap *= 2;
+        p->nodes = realloc(p->nodes, p->nodecap * sizeof(profile_node));
+    }
+    int c = p->nnodes++;
+    p->nodes[c] = (profile_node){
+        .parent = parent,
+        .slot = slot,
+        .child = -1,
+        .sibling = p->nodes[parent].child,
+    };
+    p->nodes[parent].child = c;
+    return c;
+}
+
+void profile_start(profile *p)
+{
+    p->cur = -1;
+    p->last = now_ns();
+    if (p->mode != PROFILE_SAMPLE)
+        return;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, &saved_sigprof);
+
+    long usec = p->hz < 1000000 ? 1000000 / p->hz : 1;
+    struct itimerval it = {
+        .it_interval = { .tv_sec = usec / 1000000, .tv_usec = usec % 1000000 },
+    };
+    it.it_value = it.it_interval;
+    profile_tick = 0;
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+void profile_stop(profile *p)
+{
+    flush(p);
+    p->cur = -1;
+    if (p->mode != PROFILE_SAMPLE)
+        return;
+
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    sigaction(SIGPROF, &saved_sigprof, NULL);
+    profile_tick = 0;
+}
+
+// A new run of the program starts at the root of the call tree.
+void profile_restart(profile *p)
+{
+    flush(p);
+    p->node = 0;
+    p->cur = -1;
+}
+
+void profile_switch(profile *p, int pc)
+{
+    uint64_t now = now_ns();
+    if (p->cur >= 0)
+        charge(p, p->cur, now - p->last);
+    p->last = now;
+
+    int s = p->slot[pc];
+    if (p->entry[pc])
+        p->hits[s]++;
+    p->cur = s;
+}
+
+void profile_sample(profile *p, int pc)
+{
+    profile_tick = 0;
+    charge(p, p->slot[pc], 1);
+}
+
+// The callee is named after the first line sharing the target's code, so
+// GOSUB to a REM line is reported against that line.
+void profile_call(profile *p, int target)
+{
+    flush(p);
+    int s = p->nslots;
+    if (target < p->ir->count) {
+        s = p->slot[target];
+        while (s > 0 && p->ir->lines[s - 1].index == target)
+            s--;
+        p->cur = p->slot[target];
+    }
+    p->calls[s]++;
+    p->node = child_node(p, p->node, s);
+}
+
+void profile_return(profile *p, int pc)
+{
+    flush(p);
+    if (p->node > 0)
+        p->node = p->nodes[p->node].parent;
+    if (pc < p->ir->count)
+        p->cur = p->slot[pc];
+}
+
+// ---------------- Reports ----------------
+
+static int slot_line(profile *p, int s)
+{
+    return s < p->nslots ? p->ir->lines[s].line : 0;
+}
+
+// The source is listed as written; lines that produced code get counters.
+void fprint_profile_listing(FILE *out, profile *p, const char *src)
+{
+    const char *unit = p->mode == PROFILE_COUNT ? "time ns" : "samples";
+    char *has_code = calloc(p->nslots + 1, 1);
+    for (int pc = 0; pc < p->ir->count; pc++)
+        has_code[p->slot[pc]] = 1;
+
+    fprintf(out, "%10s %12s %6s %8s | %s\n", "hits", unit, "%", "calls", "source");
+
+    for (const char *line = src; *line; ) {
+        const char *end = strchr(line, '\n');
+        int len = end ? end - line : (int)strlen(line);
+        if (len > 0 && line[len - 1] == '\r')
+            len--;
+
+        const char *s = line;
+        while (*s == ' ' || *s == '\t')
+            s++;
+        int slot = *s >= '0' && *s <= '9' ? ir_line_slot(p->ir, atoi(s)) : -1;
+
+        if (slot >= 0 && (has_code[slot] || p->calls[slot])) {
+            double pct = p->total ? 100.0 * p->weight[slot] / p->total : 0;
+            if (p->mode == PROFILE_COUNT)
+                fprintf(out, "%10llu ", (unsigned long long)p->hits[slot]);
+            else
+                fprintf(out, "%10s ", "-");
+            fprintf(out, "%12llu %5.1f%% ", (unsigned long long)p->weight[slot], pct);
+            if (p->calls[slot])
+                fprintf(out, "%8llu", (unsigned long long)p->calls[slot]);
+            else
+                fprintf(out, "%8s", "");
+        } else {
+            fprintf(out, "%10s %12s %6s %8s", "", "", "", "");
+        }
+        fprintf(out, " | %.*s\n", len, line);
+
+        if (!end)
+            break;
+        line = end + 1;
+    }
+
+    fprintf(out, "%10s %12llu %5.1f%% %8s | total\n", "",
+            (unsigned long long)p->total, 100.0, "");
+    free(has_code);
+}
+
+static void fprint_frames(FILE *out, profile *p, int node)
+{
+    if (node == 0) {
+        fputs("main", out);
+        return;
+    }
+    fprint_frames(out, p, p->nodes[node].parent);
+    fprintf(out, ";GOSUB %d", slot_line(p, p->nodes[node].slot));
+}
+
+// One line per call path and BASIC line, as consumed by flamegraph.pl.
+void fprint_profile_stacks(FILE *out, profile *p)
+{
+    for (int n = 0; n < p->nnodes; n++) {
+        if (!p->nodes[n].weight)
+            continue;
+        for (int s = 0; s <= p->nslots; s++) {
+            uint64_t w = p->nodes[n].weight[s];
+            if (!w)
+                continue;
+            fprint_frames(out, p, n);
+            fprintf(out, ";LINE %d %llu\n", slot_line(p, s), (unsigned long long)w);
+        }
+    }
+}
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "rtio.h"
+
+// ---------------- Output ----------------
+rt_output *init_rt_output(int fd, size_t cap)
+{
+    rt_output *out = calloc(1, sizeof(rt_output));
+    out->cap = cap ? cap : RT_OUTPUT_CAP;
+    out->buf = malloc(out->cap);
+    out->fd = fd;
+    return out;
+}
+
+void free_rt_output(rt_output *out)
+{
+    if (!out)
+        return;
+
+    rt_flush(out);
+    free(out->buf);
+    free(out);
+}
+
+void rt_flush(rt_output *out)
+{
+    if (out->fd < 0)
+        return;
+
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n <= 0) {
+            perror("write");
+            break;
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+// Make room for len more bytes: flush to the fd, or grow an in-memory sink.
+static void reserve(rt_output *out, size_t len)
+{
+    if (out->len + len <= out->cap)
+        return;
+
+    if (out->fd >= 0) {
+        rt_flush(out);
+        if (len <= out->cap)
+            return;
+    }
+
+    while (out->len + len > out->cap)
+        out->cap *= 2;
+    out->buf = realloc(out->buf, out->cap);
+}
+
+void rt_write(rt_output *out, const char *s, size_t len)
+{
+    reserve(out, len);
+    memcpy(out->buf + out->len, s, len);
+    out->len += len;
+
+    size_t i = len;
+    while (i > 0 && s[i - 1] != '\n')
+        i--;
+    out->col = i ? (int)(len - i) : out->col + (int)len;
+}
+
+void rt_write_str(rt_output *out, const char *s)
+{
+    rt_write(out, s, strlen(s));
+}
+
+void rt_write_char(rt_output *out, char c)
+{
+    reserve(out, 1);
+    out->buf[out->len++] = c;
+    out->col = c == '\n' ? 0 : out->col + 1;
+}
+
+// Digits are produced back to front into a small scratch buffer; values
+// are 16-bit so six characters always suffice.
+void rt_write_int(rt_output *out, int value)
+{
+    char tmp[12];
+    char *p = tmp + sizeof(tmp);
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (value < 0)
+        *--p = '-';
+
+    size_t len = tmp + sizeof(tmp) - p;
+    reserve(out, len);
+    memcpy(out->buf + out->len, p, len);
+    out->len += len;
+    out->col += (int)len;
+}
+
+// Advance to the next print zone, as a ',' separator in PRINT does.
+void rt_write_tab(rt_output *out)
+{
+    do {
+        rt_write_char(out, ' ');
+    } while (out->col % RT_TAB_WIDTH);
+}
+
+// ---------------- Input ----------------
+rt_input *init_rt_input_stdin(void)
+{
+    rt_input *in = calloc(1, sizeof(rt_input));
+    in->kind = RT_INPUT_STDIN;
+    return in;
+}
+
+rt_input *init_rt_input_values(const int16_t *values, int count)
+{
+    rt_input *in = calloc(1, sizeof(rt_input));
+    in->kind = RT_INPUT_REPLAY;
+    in->cap = count ? count : 1;
+    in->values = malloc(in->cap * sizeof(int16_t));
+    if (count)
+        memcpy(in->values, values, count * sizeof(int16_t));
+    in->count = count;
+    return in;
+}
+
+// Values out of the 16-bit range saturate.
+static int16_t clamp16(long value)
+{
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)value;
+}
+
+static int is_separator(int c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+// Append the integers read from fp to in, up to EOF or, with one_line
+// set, the end of the line. Values are separated by whitespace or commas;
+// a '-' or '+' is a sign only right before a digit, so "1-2" is 1 and -2.
+// Anything else is reported against path and *line. Returns 1 at the end
+// of a line, 0 at EOF and -1 after a token that is not a number.
+static int read_values(FILE *fp, const char *path, int *line, rt_input *in, int one_line)
+{
+    int c = fgetc(fp);
+    while (c != EOF) {
+        if (c == '\n') {
+            ++*line;
+            if (one_line)
+                return 1;
+            c = fgetc(fp);
+            continue;
+        }
+        if (is_separator(c)) {
+            c = fgetc(fp);
+            continue;
+        }
+
+        char tok[32];
+        int len = 0, sign = 1, value = 0, digits = 0;
+        if (c == '-' || c == '+') {
+            sign = c == '-' ? -1 : 1;
+            tok[len++] = c;
+            c = fgetc(fp);
+        }
+        // stop accumulating once past the 16-bit range; the rest only
+        // has to be consumed
+        while (c != EOF && isdigit(c)) {
+            if (value <= INT16_MAX + 1)
+                value = value * 10 + (c - '0');
+            if (len < (int)sizeof(tok) - 1)
+                tok[len++] = c;
+            digits++;
+            c = fgetc(fp);
+        }
+
+        int next = c == '-' || c == '+' ? fgetc(fp) : EOF;
+        if (next != EOF)
+            ungetc(next, fp);
+        int ends = c == EOF || c == '\n' || is_separator(c) || isdigit(next);
+        if (!digits || !ends) {
+            while (c != EOF && c != '\n' && !is_separator(c)) {
+                if (len < (int)sizeof(tok) - 1)
+                    tok[len++] = c;
+                c = fgetc(fp);
+            }
+            tok[len] = '\0';
+            fprintf(stderr, "%s:%d: not a number: %s\n", path, *line, tok);
+            return -1;
+        }
+
+        int16_t v = clamp16(sign * value);
+        rt_input_push(in, &v, 1);
+    }
+    return 0;
+}
+
+// Replay file: integers separated by whitespace, commas or newlines.
+rt_input *init_rt_input_file(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+
+    int line = 1;
+    rt_input *in = init_rt_input_values(NULL, 0);
+    if (read_values(fp, path, &line, in, 0) < 0) {
+        free_rt_input(in);
+        in = NULL;
+    }
+    fclose(fp);
+    return in;
+}
+
+// One replay input per line of path, for batch runs, read exactly as
+// init_rt_input_file reads a whole file; blank lines give inputs without
+// values. Returns the number of inputs, or -1.
+int rt_read_input_sets(const char *path, rt_input ***sets)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    int n = 0, cap = 16, line = 1;
+    *sets = malloc(cap * sizeof(rt_input *));
+
+    for (int more = 1; more; ) {
+        rt_input *in = init_rt_input_values(NULL, 0);
+        more = read_values(fp, path, &line, in, 1);
+
+        if (more < 0) {
+            free_rt_input(in);
+            while (n > 0)
+                free_rt_input((*sets)[--n]);
+            free(*sets);
+            n = -1;
+            break;
+        }
+        // a file ending in a newline has no line after it
+        if (!more && in->count == 0) {
+            free_rt_input(in);
+            break;
+        }
+        if (n == cap) {
+            cap *= 2;
+            *sets = realloc(*sets, cap * sizeof(rt_input *));
+        }
+        (*sets)[n++] = in;
+    }
+
+    fclose(fp);
+    return n;
+}
+
+rt_input *init_rt_input_queue(void)
+{
+    rt_input *in = calloc(1, sizeof(rt_input));
+    in->kind = RT_INPUT_QUEUE;
+    return in;
+}
+
+void free_rt_input(rt_input *in)
+{
+    if (!in)
+        return;
+
+    free(in->values);
+    free(in);
+}
+
+// Returns 0 when no more input is available.
+int rt_read_int(rt_input *in, int16_t *value)
+{
+    if (in->kind != RT_INPUT_STDIN) {
+        if (in->pos >= in->count)
+            return 0;
+        *value = in->values[in->pos++];
+        return 1;
+    }
+
+    // a line that is not one number is asked for again
+    for (;;) {
+        char line[64];
+        if (!fgets(line, sizeof(line), stdin))
+            return 0;
+
+        // the rest of an overlong line is dropped, and the line rejected
+        int whole = strchr(line, '\n') != NULL, c;
+        if (!whole && (c = getchar()) != EOF) {
+            while (c != EOF && c != '\n')
+                c = getchar();
+        } else {
+            whole = 1;
+        }
+
+        char *end;
+        long v = strtol(line, &end, 10);
+        int digits = end != line && isdigit((unsigned char)end[-1]);
+        while (*end && isspace((unsigned char)*end))
+            end++;
+        if (whole && digits && *end == '\0') {
+            *value = clamp16(v);
+            return 1;
+        }
+        fputs("not a number, try again\n? ", stdout);
+        fflush(stdout);
+    }
+}
+
+void rt_input_rewind(rt_input *in)
+{
+    in->pos = 0;
+}
+
+// Append values after dropping the ones already read.
+void rt_input_push(rt_input *in, const int16_t *values, int count)
+{
+    if (in->pos) {
+        memmove(in->values, in->values + in->pos, (in->count - in->pos) * sizeof(int16_t));
+        in->count -= in->pos;
+        in->pos = 0;
+    }
+    if (in->count + count > in->cap) {
+        while (in->count + count > in->cap)
+            in->cap = in->cap ? in->cap * 2 : 4;
+        in->values = realloc(in->values, in->cap * sizeof(int16_t));
+    }
+    memcpy(in->values + in->count, values, count * sizeof(int16_t));
+    in->count += count;
+}
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scheduler.h"
+#include "vm.h"
+#include "rtio.h"
+
+// CPU time of the calling worker thread, so a slice is not charged for
+// time the worker spent preempted by the OS.
+static uint64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// ---------------- Deques ----------------
+static void init_deque(sched_deque *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    q->cap = 64;
+    q->items = malloc(q->cap * sizeof(sched_task *));
+}
+
+static void free_deque(sched_deque *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    free(q->items);
+}
+
+// Wake one idle worker; the idle count is checked first so a busy pool
+// never touches the scheduler lock.
+static void wake(sched *s)
+{
+    if (atomic_load(&s->idle) == 0)
+        return;
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_signal(&s->work);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void deque_push(sched *s, sched_deque *q, sched_task *t)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->cap) {
+        sched_task **grown = malloc(q->cap * 2 * sizeof(sched_task *));
+        for (int i = 0; i < q->count; i++)
+            grown[i] = q->items[(q->head + i) & (q->cap - 1)];
+        free(q->items);
+        q->items = grown;
+        q->head = 0;
+        q->cap *= 2;
+    }
+    q->items[(q->head + q->count) & (q->cap - 1)] = t;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+
+    atomic_fetch_add(&s->runnable, 1);
+    wake(s);
+}
+
+// The owner takes from the front, thieves from the back.
+static sched_task *deque_take(sched *s, sched_deque *q, int back)
+{
+    sched_task *t = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->count) {
+        if (back) {
+            t = q->items[(q->head + q->count - 1) & (q->cap - 1)];
+        } else {
+            t = q->items[q->head];
+            q->head = (q->head + 1) & (q->cap - 1);
+        }
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (t)
+        atomic_fetch_sub(&s->runnable, 1);
+    return t;
+}
+
+// ---------------- Workers ----------------
+static sched_task *steal(sched_worker *w)
+{
+    sched *s = w->s;
+
+    for (int k = 1; k < s->nworkers && atomic_load(&s->runnable) > 0; k++) {
+        sched_worker *victim = &s->workers[(w->id + k) % s->nworkers];
+        sched_task *t = deque_take(s, &victim->queue, 1);
+        if (t) {
+            w->steals++;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// Returns 0 when the scheduler is shutting down.
+static int wait_for_work(sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    atomic_fetch_add(&s->idle, 1);
+    while (!s->stopping && atomic_load(&s->runnable) == 0)
+        pthread_cond_wait(&s->work, &s->lock);
+    atomic_fetch_sub(&s->idle, 1);
+    int running = !s->stopping;
+    pthread_mutex_unlock(&s->lock);
+    return running;
+}
+
+// Called with s->lock held when a task stops being runnable. A task's
+// state only changes under s->lock.
+static void deactivate(sched *s)
+{
+    if (--s->active == 0)
+        pthread_cond_broadcast(&s->quiet);
+}
+
+// The output is cut back to the limit, and so is its buffer, which may
+// have grown past it during the slice.
+static enum vm_status fail_task(sched_task *t, const char *msg)
+{
+    vm *m = t->m;
+    m->status = VM_ERROR;
+    m->error = msg;
+    m->error_line = m->pc < m->ir->count ? m->ir->code[m->pc].line : 0;
+    t->out->len = SCHED_OUTPUT_LIMIT;
+    t->out->cap = SCHED_OUTPUT_LIMIT;
+    t->out->buf = realloc(t->out->buf, SCHED_OUTPUT_LIMIT);
+    return VM_ERROR;
+}
+
+static void run_slice(sched_worker *w, sched_task *t)
+{
+    sched *s = w->s;
+
+    uint64_t start = thread_cpu_ns();
+    enum vm_status status = vm_run_slice(t->m, s->budget);
+    t->cpu_ns += thread_cpu_ns() - start;
+    t->slices++;
+    w->switches++;
+    if (t->out->len > SCHED_OUTPUT_LIMIT)
+        status = fail_task(t, "output limit");
+
+    switch (status) {
+    case VM_YIELD:
+        w->preempted++;
+        deque_push(s, &w->queue, t);
+        return;
+
+    case VM_BLOCKED:
+        w->blocked++;
+        pthread_mutex_lock(&s->lock);
+        if (t->npending) {
+            rt_input_push(t->in, t->pending, t->npending);
+            t->npending = 0;
+            t->state = TASK_RUNNABLE;
+            pthread_mutex_unlock(&s->lock);
+            deque_push(s, &w->queue, t);
+            return;
+        }
+        t->state = TASK_BLOCKED;
+        deactivate(s);
+        pthread_mutex_unlock(&s->lock);
+        return;
+
+    default:
+        pthread_mutex_lock(&s->lock);
+        t->state = TASK_DONE;
+        deactivate(s);
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    sched_worker *w = arg;
+
+    for (;;) {
+        sched_task *t = deque_take(w->s, &w->queue, 0);
+        if (!t)
+            t = steal(w);
+        if (t)
+            run_slice(w, t);
+        else if (!wait_for_work(w->s))
+            return NULL;
+    }
+}
+
+// ---------------- Scheduler ----------------
+sched *init_sched(int workers, long budget)
+{
+    sched *s = calloc(1, sizeof(sched));
+    s->nworkers = workers > 0 ? workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    s->budget = budget > 0 ? budget : SCHED_DEFAULT_BUDGET;
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->quiet, NULL);
+
+    s->workers = calloc(s->nworkers, sizeof(sched_worker));
+    for (int i = 0; i < s->nworkers; i++) {
+        s->workers[i].s = s;
+        s->workers[i].id = i;
+        init_deque(&s->workers[i].queue);
+    }
+    for (int i = 0; i < s->nworkers; i++)
+        pthread_create(&s->workers[i].thread, NULL, worker_main, &s->workers[i]);
+    return s;
+}
+
+void free_sched(sched *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = 0; i < s->nworkers; i++) {
+        pthread_join(s->workers[i].thread, NULL);
+        free_deque(&s->workers[i].queue);
+    }
+
+    for (int i = 0; i < s->ntasks; i++) {
+        sched_task *t = s->tasks[i];
+        free_vm(t->m);
+        free_rt_output(t->out);
+        free_rt_input(t->in);
+        free(t->pending);
+        free(t);
+    }
+
+    pthread_cond_destroy(&s->quiet);
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->lock);
+    free(s->tasks);
+    free(s->workers);
+    free(s);
+}
+
+// Output stays in the task's in-memory buffer until the host reads it.
+sched_task *sched_spawn(sched *s, ir_program *ir, int cold_start)
+{
+    sched_task *t = calloc(1, sizeof(sched_task));
+    t->out = init_rt_output(-1, SCHED_OUTPUT_CAP);
+    t->in = init_rt_input_queue();
+    t->m = init_vm(ir, t->out, t->in);
+    t->m->cold_start = cold_start;
+    t->state = TASK_RUNNABLE;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->ntasks == s->taskcap) {
+        s->taskcap = s->taskcap ? s->taskcap * 2 : 64;
+        s->tasks = realloc(s->tasks, s->taskcap * sizeof(sched_task *));
+    }
+    t->id = s->ntasks;
+    s->tasks[s->ntasks++] = t;
+    s->active++;
+    sched_worker *w = &s->workers[s->next_worker++ % s->nworkers];
+    pthread_mutex_unlock(&s->lock);
+
+    deque_push(s, &w->queue, t);
+    return t;
+}
+
+// A blocked task is woken right away; otherwise the values wait in
+// pending until the task next blocks on INPUT.
+void sched_feed(sched *s, sched_task *t, const int16_t *values, int count)
+{
+    pthread_mutex_lock(&s->lock);
+    if (t->state == TASK_BLOCKED) {
+        rt_input_push(t->in, values, count);
+        t->state = TASK_RUNNABLE;
+        s->active++;
+        sched_worker *w = &s->workers[s->next_worker++ % s->nworkers];
+        pthread_mutex_unlock(&s->lock);
+        deque_push(s, &w->queue, t);
+        return;
+    }
+
+    if (t->npending + count > t->pendcap) {
+        while (t->npending + count > t->pendcap)
+            t->pendcap = t->pendcap ? t->pendcap * 2 : 4;
+        t->pending = realloc(t->pending, t->pendcap * sizeof(int16_t));
+    }
+    memcpy(t->pending + t->npending, values, count * sizeof(int16_t));
+    t->npending += count;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Wait until every task has finished or is blocked on INPUT.
+void sched_wait(sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    while (s->active > 0)
+        pthread_cond_wait(&s->quiet, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Heap bytes held by one task, shared IR excluded.
+size_t sched_task_bytes(sched_task *t)
+{
+    size_t n = sizeof(sched_task) + sizeof(vm) + sizeof(rt_output) + sizeof(rt_input);
+    n += (t->m->ir->ntemps + 1) * sizeof(int16_t);
+    n += t->out->cap + t->in->cap * sizeof(int16_t) + t->pendcap * sizeof(int16_t);
+    for (int i = 0; i < VM_NPAGES; i++)
+        if (t->m->pages[i])
+            n += VM_PAGE_SIZE;
+    return n;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static const char *state_name(enum sched_state state)
+{
+    switch (state) {
+        case TASK_RUNNABLE: return "runnable";
+        case TASK_BLOCKED: return "blocked";
+        default: return "done";
+    }
+}
+
+void fprint_sched_stats(FILE *out, sched *s)
+{
+    int done = 0, blocked = 0, errors = 0;
+    uint64_t cpu = 0;
+    size_t bytes = 0;
+    uint64_t *sorted = malloc((s->ntasks ? s->ntasks : 1) * sizeof(uint64_t));
+
+    for (int i = 0; i < s->ntasks; i++) {
+        sched_task *t = s->tasks[i];
+        done += t->state == TASK_DONE;
+        blocked += t->state == TASK_BLOCKED;
+        errors += t->m->status == VM_ERROR;
+        cpu += t->cpu_ns;
+        sorted[i] = t->cpu_ns;
+        bytes += sched_task_bytes(t);
+    }
+    qsort(sorted, s->ntasks, sizeof(uint64_t), compare_u64);
+
+    int n = s->ntasks ? s->ntasks : 1;
+    fprintf(out, "tasks %d: %d done (%d with errors), %d blocked on INPUT; memory per task: %zu bytes\n",
+            s->ntasks, done, errors, blocked, bytes / n);
+    if (s->ntasks) {
+        fprintf(out, "cpu per task (us): min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f, avg %.1f\n",
+                sorted[0] / 1e3, sorted[(n - 1) / 2] / 1e3, sorted[(n - 1) * 9 / 10] / 1e3,
+                sorted[(n - 1) * 99 / 100] / 1e3, sorted[n - 1] / 1e3, cpu / 1e3 / n);
+    }
+    free(sorted);
+
+    fprintf(out, "%-8s %12s %12s %10s %10s\n", "worker", "switches", "preempted", "blocked", "steals");
+    uint64_t total[4] = { 0 };
+    for (int i = 0; i < s->nworkers; i++) {
+        sched_worker *w = &s->workers[i];
+        fprintf(out, "%-8d %12llu %12llu %10llu %10llu\n", i,
+                (unsigned long long)w->switches, (unsigned long long)w->preempted,
+                (unsigned long long)w->blocked, (unsigned long long)w->steals);
+        total[0] += w->switches;
+        total[1] += w->preempted;
+        total[2] += w->blocked;
+        total[3] += w->steals;
+    }
+    fprintf(out, "%-8s %12llu %12llu %10llu %10llu\n", "total",
+            (unsigned long long)total[0], (unsigned long long)total[1],
+            (unsigned long long)total[2], (unsigned long long)total[3]);
+}
+
+// One line per task with its own CPU time.
+void fprint_sched_tasks(FILE *out, sched *s)
+{
+    fprintf(out, "%-8s %12s %10s %-9s %s\n", "task", "cpu us", "slices", "state", "status");
+    for (int i = 0; i < s->ntasks; i++) {
+        sched_task *t = s->tasks[i];
+        fprintf(out, "%-8d %12.1f %10u %-9s %s\n", t->id, t->cpu_ns / 1e3, t->slices,
+                state_name(t->state), t->m->status == VM_ERROR ? t->m->error : "ok");
+    }
+}
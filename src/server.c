@@ -0,0 +1,679 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "tinybasic.h"
+#include "lex.h"
+#include "token.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 16384
+
+// ---------------- Jobs ----------------
+struct conn;
+
+typedef struct job {
+    struct job *next;
+    struct conn *conn;
+    uint32_t op;
+    char *src;
+    uint32_t len;
+
+    uint32_t status;
+    char *out;
+    size_t outlen;
+} job;
+
+typedef struct job_queue {
+    job *head;
+    job *tail;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} job_queue;
+
+static void queue_push(job_queue *q, job *j)
+{
+    pthread_mutex_lock(&q->lock);
+    j->next = NULL;
+    if (q->tail)
+        q->tail->next = j;
+    else
+        q->head = j;
+    q->tail = j;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Blocks until a job is available; NULL once the queue is closed.
+static job *queue_pop(job_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (!q->head && !q->closed)
+        pthread_cond_wait(&q->ready, &q->lock);
+
+    job *j = q->head;
+    if (j) {
+        q->head = j->next;
+        if (!q->head)
+            q->tail = NULL;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return j;
+}
+
+static void free_job(job *j)
+{
+    free(j->src);
+    free(j->out);
+    free(j);
+}
+
+// ---------------- Response cache ----------------
+typedef struct cache_entry {
+    uint64_t hash;
+    uint32_t op;
+    char *src;
+    uint32_t len;
+    uint32_t status;
+    char *out;
+    size_t outlen;
+} cache_entry;
+
+typedef struct response_cache {
+    cache_entry slots[TB_CACHE_SLOTS];
+    size_t bytes;       // source and dump held by all slots
+    int hand;           // next slot to evict when over TB_CACHE_BYTES
+    pthread_mutex_t lock;
+    long hits;
+    long misses;
+} response_cache;
+
+// FNV-1a over the operation and the source text.
+static uint64_t hash_request(uint32_t op, const char *src, uint32_t len)
+{
+    uint64_t h = 1469598103934665603ULL ^ op;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (unsigned char)src[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int cache_lookup(response_cache *c, job *j, uint64_t h)
+{
+    cache_entry *e = &c->slots[h % TB_CACHE_SLOTS];
+    int hit = 0;
+
+    pthread_mutex_lock(&c->lock);
+    if (e->src && e->hash == h && e->op == j->op && e->len == j->len &&
+        memcmp(e->src, j->src, j->len) == 0)
+    {
+        j->status = e->status;
+        j->outlen = e->outlen;
+        j->out = malloc(e->outlen + 1);
+        memcpy(j->out, e->out, e->outlen);
+        hit = 1;
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return hit;
+}
+
+static void cache_evict(response_cache *c, cache_entry *e)
+{
+    c->bytes -= e->len + e->outlen;
+    free(e->src);
+    free(e->out);
+    e->src = e->out = NULL;
+    e->len = 0;
+    e->outlen = 0;
+}
+
+// Direct-mapped: a new response simply replaces whatever shared its slot.
+// Past TB_CACHE_BYTES a clock hand evicts other slots in turn.
+static void cache_store(response_cache *c, job *j, uint64_t h)
+{
+    if ((size_t)j->len + j->outlen > TB_CACHE_ENTRY_MAX)
+        return;
+
+    char *src = malloc(j->len + 1);
+    char *out = malloc(j->outlen + 1);
+    memcpy(src, j->src, j->len);
+    memcpy(out, j->out, j->outlen);
+
+    pthread_mutex_lock(&c->lock);
+    cache_entry *e = &c->slots[h % TB_CACHE_SLOTS];
+    char *old_src = e->src, *old_out = e->out;
+    c->bytes += (size_t)j->len + j->outlen - e->len - e->outlen;
+    e->hash = h;
+    e->op = j->op;
+    e->src = src;
+    e->len = j->len;
+    e->status = j->status;
+    e->out = out;
+    e->outlen = j->outlen;
+
+    while (c->bytes > TB_CACHE_BYTES) {
+        cache_entry *victim = &c->slots[c->hand];
+        c->hand = (c->hand + 1) % TB_CACHE_SLOTS;
+        if (victim != e && victim->src)
+            cache_evict(c, victim);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    free(old_src);
+    free(old_out);
+}
+
+// ---------------- Connections / server state ----------------
+typedef struct conn {
+    int fd;
+    char *in;
+    size_t inlen;
+    size_t incap;
+    char *out;
+    size_t outlen;
+    size_t outpos;
+    int busy;       // a request is with the workers
+    int hangup;     // close once the queued output is written
+    int closing;    // closed; freed once no job or event refers to it
+    uint32_t events;
+    struct conn *next_dead;
+} conn;
+
+typedef struct server {
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    int signal_fd;
+
+    job_queue todo;
+    job *done;
+    pthread_mutex_t done_lock;
+
+    pthread_t *threads;
+    int nworkers;
+
+    response_cache cache;
+    long requests;
+
+    conn *dead;     // closed connections, freed after each event batch
+} server;
+
+// ---------------- Workers ----------------
+static void compile_job(tb_context *ctx, job *j)
+{
+    FILE *out = open_memstream(&j->out, &j->outlen);
+
+    switch (j->op) {
+    case TB_OP_TOKENS: {
+        tb_reset(ctx);
+        char *src = arena_strndup(ctx->mem, j->src, j->len);
+        lexer *lex = init_lexer(ctx->mem, src);
+        token *t;
+        do {
+            t = next_token(lex);
+            fprintf(out, "%s", type_to_string(t->type));
+            if (t->value && t->type != TOKEN_EOL)
+                fprintf(out, " %s", t->value);
+            fprintf(out, "\n");
+        } while (t->type != TOKEN_EOF);
+        break;
+    }
+    case TB_OP_AST:
+        fprint_ast(out, tb_parse(ctx, j->src, j->len), 0);
+        break;
+    case TB_OP_IR:
+        fprint_ir(out, tb_compile(ctx, j->src, j->len, 1));
+        break;
+    }
+
+    j->status = TB_STATUS_OK;
+    if (j->op != TB_OP_TOKENS && tb_diagnostic_count(ctx)) {
+        j->status = TB_STATUS_ERRORS;
+        tb_fprint_diagnostics(out, ctx, "<request>");
+    }
+    fclose(out);
+}
+
+static void *worker_main(void *arg)
+{
+    server *s = arg;
+    tb_context *ctx = tb_init();
+    job *j;
+
+    while ((j = queue_pop(&s->todo))) {
+        uint64_t h = hash_request(j->op, j->src, j->len);
+        if (!cache_lookup(&s->cache, j, h)) {
+            compile_job(ctx, j);
+            cache_store(&s->cache, j, h);
+        }
+
+        pthread_mutex_lock(&s->done_lock);
+        j->next = s->done;
+        s->done = j;
+        pthread_mutex_unlock(&s->done_lock);
+
+        uint64_t one = 1;
+        if (write(s->wake_fd, &one, sizeof(one)) < 0)
+            perror("write");
+    }
+
+    tb_free(ctx);
+    return NULL;
+}
+
+// ---------------- Event loop ----------------
+static void watch(server *s, conn *c, uint32_t events, int op)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(s->epoll_fd, op, c->fd, &ev);
+    c->events = events;
+}
+
+// Input is only read while no request is with the workers, so a client
+// cannot queue more than one request's worth in the daemon.
+static void update_events(server *s, conn *c)
+{
+    uint32_t events = (c->busy || c->hangup ? 0 : EPOLLIN) |
+                      (c->outpos < c->outlen ? EPOLLOUT : 0);
+    if (!c->closing && events != c->events)
+        watch(s, c, events, EPOLL_CTL_MOD);
+}
+
+// Events already returned by epoll_wait may still name c, and a busy c is
+// named by its job, so the struct is only freed by reap_conns.
+static void close_conn(server *s, conn *c)
+{
+    if (!c->closing) {
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->closing = 1;
+    }
+    if (!c->busy) {
+        c->next_dead = s->dead;
+        s->dead = c;
+    }
+}
+
+static void reap_conns(server *s)
+{
+    while (s->dead) {
+        conn *c = s->dead;
+        s->dead = c->next_dead;
+        free(c->in);
+        free(c->out);
+        free(c);
+    }
+}
+
+static void append_out(conn *c, const void *data, size_t len)
+{
+    c->out = realloc(c->out, c->outlen + len);
+    memcpy(c->out + c->outlen, data, len);
+    c->outlen += len;
+}
+
+// Returns 0 if the connection failed and was closed.
+static int flush_conn(server *s, conn *c)
+{
+    while (c->outpos < c->outlen) {
+        ssize_t n = write(c->fd, c->out + c->outpos, c->outlen - c->outpos);
+        if (n < 0 && errno == EAGAIN) {
+            update_events(s, c);
+            return 1;
+        }
+        if (n <= 0) {
+            close_conn(s, c);
+            return 0;
+        }
+        c->outpos += n;
+    }
+
+    c->outlen = c->outpos = 0;
+    if (c->hangup) {
+        close_conn(s, c);
+        return 0;
+    }
+    update_events(s, c);
+    return 1;
+}
+
+// Answer BAD_REQUEST and close once the reply is out.
+static int reject(server *s, conn *c)
+{
+    tb_header reply = { TB_STATUS_BAD_REQUEST, 0 };
+    append_out(c, &reply, sizeof(reply));
+    c->hangup = 1;
+    flush_conn(s, c);
+    return 0;
+}
+
+// Hand the next complete request to the workers, one at a time per
+// connection so responses stay in order. Returns 0 if c was closed.
+static int dispatch(server *s, conn *c)
+{
+    if (c->busy || c->hangup || c->inlen < sizeof(tb_header))
+        return 1;
+
+    tb_header h;
+    memcpy(&h, c->in, sizeof(h));
+
+    if (h.length > TB_MAX_REQUEST ||
+        (h.word != TB_OP_TOKENS && h.word != TB_OP_AST && h.word != TB_OP_IR))
+        return reject(s, c);
+
+    if (c->inlen < sizeof(h) + h.length)
+        return 1;
+
+    job *j = calloc(1, sizeof(job));
+    j->conn = c;
+    j->op = h.word;
+    j->len = h.length;
+    j->src = malloc(h.length + 1);
+    memcpy(j->src, c->in + sizeof(h), h.length);
+
+    c->inlen -= sizeof(h) + h.length;
+    memmove(c->in, c->in + sizeof(h) + h.length, c->inlen);
+    c->busy = 1;
+    s->requests++;
+    queue_push(&s->todo, j);
+    update_events(s, c);
+    return 1;
+}
+
+static void accept_conns(server *s)
+{
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        conn *c = calloc(1, sizeof(conn));
+        c->fd = fd;
+        watch(s, c, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+static void read_conn(server *s, conn *c)
+{
+    // never buffer more than one largest request plus a byte to notice it
+    size_t limit = sizeof(tb_header) + TB_MAX_REQUEST;
+
+    while (!c->busy && !c->hangup) {
+        if (c->incap - c->inlen < READ_CHUNK) {
+            c->incap = c->incap ? c->incap * 2 : READ_CHUNK * 2;
+            c->in = realloc(c->in, c->incap);
+        }
+
+        size_t room = c->incap - c->inlen;
+        if (room > limit + 1 - c->inlen)
+            room = limit + 1 - c->inlen;
+        ssize_t n = read(c->fd, c->in + c->inlen, room);
+        if (n > 0) {
+            c->inlen += n;
+            if (!dispatch(s, c))
+                return;
+            if (!c->busy && c->inlen > limit) {
+                reject(s, c);
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN)
+            break;
+
+        // peer closed or failed; a busy connection is freed when its job returns
+        close_conn(s, c);
+        return;
+    }
+    update_events(s, c);
+}
+
+static void complete_jobs(server *s)
+{
+    uint64_t n;
+    if (read(s->wake_fd, &n, sizeof(n)) < 0)
+        return;
+
+    pthread_mutex_lock(&s->done_lock);
+    job *j = s->done;
+    s->done = NULL;
+    pthread_mutex_unlock(&s->done_lock);
+
+    while (j) {
+        job *next = j->next;
+        conn *c = j->conn;
+
+        c->busy = 0;
+        if (c->closing) {
+            close_conn(s, c);
+        } else {
+            tb_header reply = { j->status, (uint32_t)j->outlen };
+            append_out(c, &reply, sizeof(reply));
+            append_out(c, j->out, j->outlen);
+            if (flush_conn(s, c) && dispatch(s, c))
+                update_events(s, c);
+        }
+
+        free_job(j);
+        j = next;
+    }
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // only a socket left by an earlier daemon may be replaced
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int tb_serve(const char *path, int workers)
+{
+    server *s = calloc(1, sizeof(server));
+
+    // SIGINT/SIGTERM arrive on a signalfd; block them before threads start
+    // so every worker inherits the mask.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    s->listen_fd = listen_on(path);
+    if (s->listen_fd < 0) {
+        free(s);
+        return 1;
+    }
+    s->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    int fds[] = { s->listen_fd, s->wake_fd, s->signal_fd };
+    for (int i = 0; i < 3; i++) {
+        // the address of each fd field marks its events apart from conns
+        struct epoll_event ev = { .events = EPOLLIN };
+        ev.data.ptr = i == 0 ? (void *)&s->listen_fd :
+                      i == 1 ? (void *)&s->wake_fd : (void *)&s->signal_fd;
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+
+    pthread_mutex_init(&s->todo.lock, NULL);
+    pthread_cond_init(&s->todo.ready, NULL);
+    pthread_mutex_init(&s->done_lock, NULL);
+    pthread_mutex_init(&s->cache.lock, NULL);
+
+    s->nworkers = workers > 0 ? workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    s->threads = calloc(s->nworkers, sizeof(pthread_t));
+    for (int i = 0; i < s->nworkers; i++)
+        pthread_create(&s->threads[i], NULL, worker_main, s);
+
+    fprintf(stderr, "listening on %s with %d workers\n", path, s->nworkers);
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(s->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+
+            if (tag == &s->listen_fd) {
+                accept_conns(s);
+            } else if (tag == &s->wake_fd) {
+                complete_jobs(s);
+            } else if (tag == &s->signal_fd) {
+                running = 0;
+            } else {
+                conn *c = tag;
+                if (c->closing)
+                    continue;
+                if (events[i].events & EPOLLOUT) {
+                    if (!flush_conn(s, c))
+                        continue;
+                }
+                // HUP and ERR are reported even while EPOLLIN is off
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) && (c->busy || c->hangup))
+                    close_conn(s, c);
+                else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read_conn(s, c);
+            }
+        }
+        reap_conns(s);
+    }
+
+    pthread_mutex_lock(&s->todo.lock);
+    s->todo.closed = 1;
+    pthread_cond_broadcast(&s->todo.ready);
+    pthread_mutex_unlock(&s->todo.lock);
+    for (int i = 0; i < s->nworkers; i++)
+        pthread_join(s->threads[i], NULL);
+
+    fprintf(stderr, "served %ld requests, cache %ld hits / %ld misses\n",
+            s->requests, s->cache.hits, s->cache.misses);
+
+    for (int i = 0; i < TB_CACHE_SLOTS; i++) {
+        free(s->cache.slots[i].src);
+        free(s->cache.slots[i].out);
+    }
+    close(s->listen_fd);
+    close(s->wake_fd);
+    close(s->signal_fd);
+    close(s->epoll_fd);
+    unlink(path);
+    free(s->threads);
+    free(s);
+    return 0;
+}
+
+// ---------------- Client side ----------------
+int tb_connect(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send one request and wait for its response. body is malloc'd and
+// NUL-terminated; the caller frees it.
+int tb_request(int fd, uint32_t op, const char *src, uint32_t len,
+               uint32_t *status, char **body, uint32_t *body_len)
+{
+    tb_header h = { op, len };
+    if (write_all(fd, &h, sizeof(h)) < 0 || write_all(fd, src, len) < 0)
+        return -1;
+
+    if (read_all(fd, &h, sizeof(h)) < 0)
+        return -1;
+
+    char *buf = malloc(h.length + 1);
+    if (read_all(fd, buf, h.length) < 0) {
+        free(buf);
+        return -1;
+    }
+    buf[h.length] = '\0';
+
+    *status = h.word;
+    *body_len = h.length;
+    if (body)
+        *body = buf;
+    else
+        free(buf);
+    return 0;
+}
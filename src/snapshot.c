@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "ir.h"
+#include "vm.h"
+
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+static int write_padding(FILE *fp, size_t len)
+{
+    static const char zeros[8];
+    size_t pad = ALIGN8(len) - len;
+    return pad && fwrite(zeros, 1, pad, fp) != pad ? -1 : 0;
+}
+
+static int write_section(FILE *fp, const void *data, size_t len)
+{
+    if (len && fwrite(data, 1, len, fp) != len)
+        return -1;
+    return write_padding(fp, len);
+}
+
+// The output is flushed first; text already printed is not part of the
+// state. The file is written next to path and renamed into place.
+int save_snapshot(vm *m, const char *path)
+{
+    ir_program *ir = m->ir;
+    snapshot_header h;
+    memset(&h, 0, sizeof(h));
+
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.instr_size = sizeof(ir_instr);
+    h.count = ir->count;
+    h.nlines = ir->nlines;
+    h.nstrings = ir->nstrings;
+    h.ntemps = ir->ntemps;
+    h.has_dynamic_jumps = ir->has_dynamic_jumps;
+    for (int i = 0; i < ir->nstrings; i++)
+        h.strings_len += strlen(ir->strings[i]) + 1;
+
+    h.pc = m->pc;
+    h.sp = m->sp;
+    memcpy(h.stack, m->stack, sizeof(h.stack));
+    memcpy(h.vars, m->vars, sizeof(h.vars));
+    h.usr_arg = m->usr_arg;
+    h.col = m->out ? m->out->col : 0;
+    h.cold_start = m->cold_start;
+    h.prompted = m->prompted;
+
+    int npages = 0;
+    for (int i = 0; i < VM_NPAGES; i++) {
+        h.page_map[i] = m->pages[i] != NULL;
+        npages += h.page_map[i];
+    }
+
+    h.code_off = ALIGN8(sizeof(h));
+    h.lines_off = h.code_off + ALIGN8((uint64_t)ir->count * sizeof(ir_instr));
+    h.strings_off = h.lines_off + ALIGN8((uint64_t)ir->nlines * sizeof(ir_line));
+    h.temps_off = h.strings_off + ALIGN8(h.strings_len);
+    h.pages_off = h.temps_off + ALIGN8((uint64_t)(ir->ntemps + 1) * sizeof(int16_t));
+    h.size = h.pages_off + (uint64_t)npages * VM_PAGE_SIZE;
+
+    if (m->out)
+        rt_flush(m->out);
+
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 5);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+        free(tmp);
+        return -1;
+    }
+
+    int rc = write_section(fp, &h, sizeof(h));
+    rc |= write_section(fp, ir->code, ir->count * sizeof(ir_instr));
+    rc |= write_section(fp, ir->lines, ir->nlines * sizeof(ir_line));
+    for (int i = 0; i < ir->nstrings; i++)
+        rc |= fwrite(ir->strings[i], 1, strlen(ir->strings[i]) + 1, fp) == 0 ? -1 : 0;
+    rc |= write_padding(fp, h.strings_len);
+    rc |= write_section(fp, m->temps, (ir->ntemps + 1) * sizeof(int16_t));
+    for (int i = 0; i < VM_NPAGES; i++)
+        if (m->pages[i])
+            rc |= write_section(fp, m->pages[i], VM_PAGE_SIZE);
+
+    if (fclose(fp) != 0 || rc != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+static int section_ok(const snapshot_header *h, uint64_t off, uint64_t len)
+{
+    return off % 8 == 0 && off <= h->size && len <= h->size - off;
+}
+
+static int operand_ok(const snapshot_header *h, ir_operand o)
+{
+    switch (o.kind) {
+        case OPERAND_NONE: case OPERAND_CONST: return 1;
+        case OPERAND_VAR: return o.value >= 0 && o.value < VM_NVARS;
+        case OPERAND_TEMP: return o.value >= 0 && (uint32_t)o.value <= h->ntemps;
+        case OPERAND_STRING: return o.value >= 0 && (uint32_t)o.value < h->nstrings;
+        default: return 0;
+    }
+}
+
+// The VM trusts its program, so everything it indexes with is checked.
+static int validate(const snapshot_header *h, const char *base)
+{
+    int npages = 0;
+    for (int i = 0; i < VM_NPAGES; i++)
+        npages += h->page_map[i] != 0;
+
+    if (!section_ok(h, h->code_off, (uint64_t)h->count * sizeof(ir_instr)) ||
+        !section_ok(h, h->lines_off, (uint64_t)h->nlines * sizeof(ir_line)) ||
+        !section_ok(h, h->strings_off, h->strings_len) ||
+        !section_ok(h, h->temps_off, ((uint64_t)h->ntemps + 1) * sizeof(int16_t)) ||
+        !section_ok(h, h->pages_off, (uint64_t)npages * VM_PAGE_SIZE))
+        return 0;
+
+    const char *s = base + h->strings_off, *end = s + h->strings_len;
+    for (uint32_t i = 0; i < h->nstrings; i++) {
+        const char *nul = memchr(s, '\0', end - s);
+        if (!nul)
+            return 0;
+        s = nul + 1;
+    }
+
+    const ir_instr *code = (const ir_instr *)(base + h->code_off);
+    for (uint32_t i = 0; i < h->count; i++) {
+        const ir_instr *in = &code[i];
+        if ((unsigned)in->op > IR_USR || in->target < -1 || in->target > (int)h->count ||
+            !operand_ok(h, in->dst) || !operand_ok(h, in->a) || !operand_ok(h, in->b))
+            return 0;
+    }
+
+    const ir_line *lines = (const ir_line *)(base + h->lines_off);
+    for (uint32_t i = 0; i < h->nlines; i++)
+        if (lines[i].index < 0 || lines[i].index > (int)h->count ||
+            (i > 0 && lines[i].line <= lines[i - 1].line))
+            return 0;
+
+    if (h->pc < 0 || h->pc > (int)h->count || h->sp < 0 || h->sp > VM_STACK_DEPTH)
+        return 0;
+    for (int i = 0; i < h->sp; i++)
+        if (h->stack[i] < 0 || h->stack[i] > (int)h->count)
+            return 0;
+    return 1;
+}
+
+snapshot *load_snapshot(const char *path, rt_output *out, rt_input *in)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snapshot_header)) {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    // private and writable: POKEs and the VM's writes never reach the file
+    size_t size = st.st_size;
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    const snapshot_header *h = (const snapshot_header *)base;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != SNAPSHOT_VERSION || h->instr_size != sizeof(ir_instr) ||
+        h->size != size || !validate(h, base))
+    {
+        fprintf(stderr, "%s: not a snapshot from this build, or corrupt\n", path);
+        munmap(base, size);
+        return NULL;
+    }
+
+    snapshot *s = calloc(1, sizeof(snapshot));
+    s->base = base;
+    s->size = size;
+
+    ir_program *ir = calloc(1, sizeof(ir_program));
+    ir->code = (ir_instr *)(base + h->code_off);
+    ir->count = ir->cap = h->count;
+    ir->lines = (ir_line *)(base + h->lines_off);
+    ir->nlines = ir->linecap = h->nlines;
+    ir->ntemps = h->ntemps;
+    ir->has_dynamic_jumps = h->has_dynamic_jumps;
+    ir->strings = malloc((h->nstrings ? h->nstrings : 1) * sizeof(char *));
+    ir->nstrings = ir->strcap = h->nstrings;
+    char *str = base + h->strings_off;
+    for (uint32_t i = 0; i < h->nstrings; i++) {
+        ir->strings[i] = str;
+        str += strlen(str) + 1;
+    }
+    s->ir = ir;
+
+    vm *m = init_vm(ir, out, in);
+    m->pc = h->pc;
+    m->sp = h->sp;
+    memcpy(m->stack, h->stack, sizeof(m->stack));
+    memcpy(m->vars, h->vars, sizeof(m->vars));
+    memcpy(m->temps, base + h->temps_off, (h->ntemps + 1) * sizeof(int16_t));
+    m->usr_arg = h->usr_arg;
+    m->cold_start = h->cold_start;
+    m->prompted = h->prompted;
+    if (out)
+        out->col = h->col;
+
+    char *page = base + h->pages_off;
+    for (int i = 0; i < VM_NPAGES; i++) {
+        if (h->page_map[i]) {
+            m->pages[i] = (uint8_t *)page;
+            page += VM_PAGE_SIZE;
+        }
+    }
+    s->m = m;
+    return s;
+}
+
+void free_snapshot(snapshot *s)
+{
+    if (!s)
+        return;
+
+    // pages inside the mapping are not the VM's to free
+    char *base = s->base;
+    for (int i = 0; i < VM_NPAGES; i++) {
+        char *page = (char *)s->m->pages[i];
+        if (page >= base && page < base + s->size)
+            s->m->pages[i] = NULL;
+    }
+    free_vm(s->m);
+
+    free(s->ir->strings);
+    free(s->ir);
+    munmap(s->base, s->size);
+    free(s);
+}
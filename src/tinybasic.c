@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tinybasic.h"
+#include "arena.h"
+#include "lex.h"
+#include "parse.h"
+#include "ir.h"
+
+tb_context *tb_init(void)
+{
+    tb_context *ctx = calloc(1, sizeof(tb_context));
+    ctx->mem = init_arena(ARENA_BLOCK_SIZE);
+    return ctx;
+}
+
+void tb_free(tb_context *ctx)
+{
+    if (!ctx)
+        return;
+
+    free_ir_program(ctx->ir);
+    free_arena(ctx->mem);
+    free(ctx);
+}
+
+// Release the previous compilation but keep the arena's first block warm.
+void tb_reset(tb_context *ctx)
+{
+    free_ir_program(ctx->ir);
+    arena_reset(ctx->mem);
+    ctx->src = NULL;
+    ctx->program = NULL;
+    ctx->ir = NULL;
+    ctx->diags = NULL;
+    ctx->ndiags = 0;
+}
+
+ast *tb_parse(tb_context *ctx, const char *src, size_t len)
+{
+    tb_reset(ctx);
+
+    // the lexer needs a NUL-terminated buffer it can index freely
+    ctx->src = arena_strndup(ctx->mem, src, len);
+
+    lexer *lex = init_lexer(ctx->mem, ctx->src);
+    parser *p = init_parser(lex);
+    ctx->program = parse(p);
+    ctx->diags = p->diags;
+    ctx->ndiags = p->ndiags;
+    return ctx->program;
+}
+
+ir_program *tb_compile(tb_context *ctx, const char *src, size_t len, int optimize)
+{
+    tb_parse(ctx, src, len);
+
+    ctx->ir = ir_lower(ctx->program);
+    if (optimize)
+        ir_optimize(ctx->ir, NULL);
+    return ctx->ir;
+}
+
+int tb_diagnostic_count(tb_context *ctx)
+{
+    return ctx->ndiags;
+}
+
+diagnostic *tb_diagnostic(tb_context *ctx, int i)
+{
+    return i >= 0 && i < ctx->ndiags ? &ctx->diags[i] : NULL;
+}
+
+void tb_fprint_diagnostics(FILE *out, tb_context *ctx, const char *filename)
+{
+    for (int i = 0; i < ctx->ndiags; i++)
+        fprint_diagnostic(out, filename, &ctx->diags[i]);
+}
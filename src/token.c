@@ -1,9 +1,9 @@
 #include "token.h"
 #include <stdlib.h>
 
-token *init_token(char *value, int type)
+token *init_token(arena *mem, char *value, int type)
 {
-    token *token = calloc(1, sizeof(struct token));
+    token *token = arena_alloc(mem, sizeof(struct token));
     token->value = value;
     token->type = type;
     return token;
@@ -32,6 +32,8 @@ char *type_to_string(int token)
         return "TOKEN_EOL";
     case TOKEN_EOF:
         return "TOKEN_EOF";
+    case TOKEN_ERROR:
+        return "TOKEN_ERROR";
     }
     return "nope";
 }
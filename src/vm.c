@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "vm.h"
+#include "ir.h"
+#include "rtio.h"
+
+vm *init_vm(ir_program *ir, rt_output *out, rt_input *in)
+{
+    vm *m = calloc(1, sizeof(vm));
+    m->ir = ir;
+    m->out = out;
+    m->in = in;
+    m->temps = calloc(ir->ntemps + 1, sizeof(int16_t));
+    m->cold_start = VM_COLD_START;
+    m->break_pc = -1;
+    return m;
+}
+
+void free_vm(vm *m)
+{
+    if (!m)
+        return;
+
+    free(m->temps);
+    for (int i = 0; i < VM_NPAGES; i++)
+        free(m->pages[i]);
+    free(m);
+}
+
+void vm_reset(vm *m)
+{
+    m->pc = 0;
+    m->sp = 0;
+    memset(m->vars, 0, sizeof(m->vars));
+    memset(m->temps, 0, (m->ir->ntemps + 1) * sizeof(int16_t));
+    for (int i = 0; i < VM_NPAGES; i++)
+        if (m->pages[i])
+            memset(m->pages[i], 0, VM_PAGE_SIZE);
+    m->usr_arg = 0;
+    m->prompted = 0;
+    m->status = VM_RUNNING;
+    m->error = NULL;
+    m->error_line = 0;
+    if (m->prof)
+        profile_restart(m->prof);
+}
+
+static inline int16_t load(vm *m, ir_operand o)
+{
+    switch (o.kind) {
+        case OPERAND_CONST: return (int16_t)o.value;
+        case OPERAND_VAR: return m->vars[o.value];
+        case OPERAND_TEMP: return m->temps[o.value];
+        default: return 0;
+    }
+}
+
+static inline void store(vm *m, ir_operand o, int value)
+{
+    if (o.kind == OPERAND_VAR)
+        m->vars[o.value] = (int16_t)value;
+    else
+        m->temps[o.value] = (int16_t)value;
+}
+
+// rel counts from LT in the order LT, LE, GT, GE, EQ, NE.
+static inline int relation(int rel, int a, int b)
+{
+    switch (rel) {
+        case 0: return a < b;
+        case 1: return a <= b;
+        case 2: return a > b;
+        case 3: return a >= b;
+        case 4: return a == b;
+        default: return a != b;
+    }
+}
+
+static uint8_t peek(vm *m, uint16_t addr)
+{
+    uint8_t *page = m->pages[addr / VM_PAGE_SIZE];
+    return page ? page[addr % VM_PAGE_SIZE] : 0;
+}
+
+static uint8_t poke(vm *m, uint16_t addr, uint8_t value)
+{
+    uint8_t **page = &m->pages[addr / VM_PAGE_SIZE];
+    if (!*page)
+        *page = calloc(VM_PAGE_SIZE, 1);
+    return (*page)[addr % VM_PAGE_SIZE] = value;
+}
+
+static enum vm_status fail(vm *m, int pc, const char *msg)
+{
+    m->pc = pc;
+    m->status = VM_ERROR;
+    m->error = msg;
+    m->error_line = pc < m->ir->count ? m->ir->code[pc].line : 0;
+    return VM_ERROR;
+}
+
+// Run until END, the end of the program or a runtime error.
+enum vm_status vm_run(vm *m)
+{
+    return vm_run_slice(m, LONG_MAX);
+}
+
+// Run at most budget instructions; VM_YIELD means the program is not done.
+enum vm_status vm_run_slice(vm *m, long budget)
+{
+    const ir_instr *code = m->ir->code;
+    int count = m->ir->count;
+    profile *prof = m->prof;
+    int pc = m->pc;
+
+    while (pc < count) {
+        const ir_instr *in = &code[pc];
+        int a, b;
+
+        if (budget-- == 0) {
+            m->pc = pc;
+            m->status = VM_YIELD;
+            return VM_YIELD;
+        }
+        if (pc == m->break_pc) {
+            m->break_pc = -1;
+            m->pc = pc;
+            m->status = VM_BREAK;
+            return VM_BREAK;
+        }
+        if (prof)
+            profile_step(prof, pc);
+
+        switch (in->op) {
+        case IR_NOP:
+            break;
+        case IR_MOV:
+            store(m, in->dst, load(m, in->a));
+            break;
+        case IR_ADD:
+            store(m, in->dst, load(m, in->a) + load(m, in->b));
+            break;
+        case IR_SUB:
+            store(m, in->dst, load(m, in->a) - load(m, in->b));
+            break;
+        case IR_MUL:
+            store(m, in->dst, load(m, in->a) * load(m, in->b));
+            break;
+        case IR_DIV:
+            b = load(m, in->b);
+            if (b == 0)
+                return fail(m, pc, "division by zero");
+            store(m, in->dst, load(m, in->a) / b);
+            break;
+        case IR_LT: store(m, in->dst, load(m, in->a) < load(m, in->b)); break;
+        case IR_LE: store(m, in->dst, load(m, in->a) <= load(m, in->b)); break;
+        case IR_GT: store(m, in->dst, load(m, in->a) > load(m, in->b)); break;
+        case IR_GE: store(m, in->dst, load(m, in->a) >= load(m, in->b)); break;
+        case IR_EQ: store(m, in->dst, load(m, in->a) == load(m, in->b)); break;
+        case IR_NE: store(m, in->dst, load(m, in->a) != load(m, in->b)); break;
+
+        case IR_JMP:
+            if (in->target < 0)
+                return fail(m, pc, "undefined line");
+            pc = in->target;
+            continue;
+        case IR_JZ:
+        case IR_JNZ:
+            if ((load(m, in->a) != 0) == (in->op == IR_JNZ)) {
+                if (in->target < 0)
+                    return fail(m, pc, "undefined line");
+                pc = in->target;
+                continue;
+            }
+            break;
+        case IR_JLT: case IR_JLE: case IR_JGT:
+        case IR_JGE: case IR_JEQ: case IR_JNE:
+            if (relation(in->op - IR_JLT, load(m, in->a), load(m, in->b))) {
+                if (in->target < 0)
+                    return fail(m, pc, "undefined line");
+                pc = in->target;
+                continue;
+            }
+            break;
+        case IR_LOOP_LT: case IR_LOOP_LE: case IR_LOOP_GT:
+        case IR_LOOP_GE: case IR_LOOP_EQ: case IR_LOOP_NE:
+            a = (int16_t)(load(m, in->dst) + load(m, in->a));
+            store(m, in->dst, a);
+            if (relation(in->op - IR_LOOP_LT, a, load(m, in->b))) {
+                pc = in->target;
+                continue;
+            }
+            break;
+
+        case IR_GOSUB:
+        case IR_GOSUB_LINE: {
+            int target = in->op == IR_GOSUB ? in->target : ir_find_line(m->ir, load(m, in->a));
+            if (target < 0)
+                return fail(m, pc, "undefined line");
+            if (m->sp == VM_STACK_DEPTH)
+                return fail(m, pc, "GOSUB nesting too deep");
+            m->stack[m->sp++] = pc + 1;
+            if (prof)
+                profile_call(prof, target);
+            pc = target;
+            continue;
+        }
+        case IR_GOTO_LINE: {
+            int target = ir_find_line(m->ir, load(m, in->a));
+            if (target < 0)
+                return fail(m, pc, "undefined line");
+            pc = target;
+            continue;
+        }
+        case IR_RETURN:
+            if (m->sp == 0)
+                return fail(m, pc, "RETURN without GOSUB");
+            pc = m->stack[--m->sp];
+            if (prof)
+                profile_return(prof, pc);
+            continue;
+        case IR_END:
+            m->pc = pc;
+            m->status = VM_END;
+            return VM_END;
+
+        case IR_PRINT:
+            if (in->a.kind == OPERAND_STRING)
+                rt_write_str(m->out, m->ir->strings[in->a.value]);
+            else
+                rt_write_int(m->out, load(m, in->a));
+            break;
+        case IR_PRINT_TAB:
+            rt_write_tab(m->out);
+            break;
+        case IR_PRINT_NL:
+            rt_write_char(m->out, '\n');
+            break;
+        case IR_INPUT: {
+            int16_t value;
+            if (!m->prompted)
+                rt_write_str(m->out, "? ");
+            if (m->in->kind == RT_INPUT_STDIN)
+                rt_flush(m->out);
+            if (!rt_read_int(m->in, &value)) {
+                if (m->in->kind != RT_INPUT_QUEUE)
+                    return fail(m, pc, "out of input");
+                m->prompted = 1;
+                m->pc = pc;
+                m->status = VM_BLOCKED;
+                return VM_BLOCKED;
+            }
+            m->prompted = 0;
+            if (m->in->kind == RT_INPUT_STDIN) {
+                m->out->col = 0;
+            } else {
+                // echo replayed input so the transcript reads like a session
+                rt_write_int(m->out, value);
+                rt_write_char(m->out, '\n');
+            }
+            store(m, in->dst, value);
+            break;
+        }
+
+        case IR_USR_ARG:
+            m->usr_arg = load(m, in->a);
+            break;
+        case IR_USR: {
+            uint16_t addr = (uint16_t)load(m, in->b);
+
+            switch ((uint16_t)(load(m, in->a) - m->cold_start)) {
+            case VM_USR_PEEK:
+                store(m, in->dst, peek(m, addr));
+                break;
+            case VM_USR_POKE:
+                store(m, in->dst, poke(m, addr, (uint8_t)m->usr_arg));
+                break;
+            default:
+                return fail(m, pc, "USR routine not supported");
+            }
+            m->usr_arg = 0;
+            break;
+        }
+        }
+        pc++;
+    }
+
+    m->pc = pc;
+    m->status = VM_END;
+    return VM_END;
+}
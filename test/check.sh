@@ -0,0 +1,117 @@
+#!/bin/sh
+# Regression checks, run by `make check`.
+#
+# Every test/NAME.bss that has a NAME.out is run with --run and its output
+# compared with NAME.out; NAME.in, if present, is replayed as its input.
+# The same program is also run after the IR passes (-O --run), which must
+# not change what it prints.
+#
+# NAME.at holds a line number and a count of input values: the run is
+# snapshotted when it first reaches that line, having read that many
+# values, and restored with the rest of the input. Both halves together
+# must print NAME.out.
+#
+# Each program is also run on one lane of --batch. NAME.batch holds one
+# input set per line; every lane of --batch NAME.batch, with and without
+# the AVX2 kernels, must print what --run prints for that line alone.
+#
+# Every line of NAME.bad is an input file that must be rejected as
+# "not a number", both by --input and by --batch.
+#
+# Usage: test/check.sh [path/to/main]
+
+MAIN=${1:-./main}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+passed=0
+failed=0
+
+# check NAME WHAT ACTUAL EXPECTED
+check() {
+    if cmp -s "$3" "$4"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL: $1: $2"
+        diff "$4" "$3" | head -20
+        failed=$((failed + 1))
+    fi
+}
+
+for bss in "$DIR"/*.bss; do
+    name=${bss%.bss}
+    test=$(basename "$name")
+    [ -f "$name.out" ] || continue
+
+    input=
+    [ -f "$name.in" ] && input="--input $name.in"
+
+    "$MAIN" --run $input "$bss" >"$TMP/run" 2>/dev/null
+    check "$test" "--run" "$TMP/run" "$name.out"
+
+    "$MAIN" -O --run $input "$bss" >"$TMP/opt" 2>/dev/null
+    check "$test" "-O --run" "$TMP/opt" "$name.out"
+
+    if [ -f "$name.at" ]; then
+        read -r line skip <"$name.at"
+        : >"$TMP/rest"
+        [ -f "$name.in" ] && tr -s ' ,\t' '\n\n\n' <"$name.in" | sed '/^$/d' |
+            tail -n +$((skip + 1)) >"$TMP/rest"
+        rm -f "$TMP/snap"
+        "$MAIN" --run $input --snapshot "$TMP/snap" --snapshot-at "$line" "$bss" \
+            >"$TMP/before" 2>/dev/null
+        : >"$TMP/after"
+        [ -f "$TMP/snap" ] &&
+            "$MAIN" --restore "$TMP/snap" --input "$TMP/rest" >"$TMP/after" 2>/dev/null
+        # a run that never stopped at the line printed everything itself
+        [ -f "$TMP/snap" ] || echo "(no snapshot written)" >>"$TMP/after"
+        cat "$TMP/before" "$TMP/after" >"$TMP/restored"
+        check "$test" "--snapshot-at $line, --restore" "$TMP/restored" "$name.out"
+    fi
+
+    if [ -f "$name.in" ]; then
+        tr '\n' ' ' <"$name.in" >"$TMP/set"
+        echo >>"$TMP/set"
+    else
+        echo >"$TMP/set"
+    fi
+    "$MAIN" --batch "$TMP/set" "$bss" 2>/dev/null | sed 1d >"$TMP/lane"
+    check "$test" "--batch" "$TMP/lane" "$name.out"
+
+    if [ -f "$name.batch" ]; then
+        i=0
+        : >"$TMP/lanes"
+        while IFS= read -r values || [ -n "$values" ]; do
+            i=$((i + 1))
+            [ "$i" -gt 1 ] && echo >>"$TMP/lanes"
+            echo "==> input $i <==" >>"$TMP/lanes"
+            printf '%s\n' "$values" >"$TMP/one"
+            "$MAIN" --run --input "$TMP/one" "$bss" >>"$TMP/lanes" 2>/dev/null
+        done <"$name.batch"
+
+        "$MAIN" --batch "$name.batch" "$bss" >"$TMP/batch" 2>/dev/null
+        check "$test" "--batch $test.batch" "$TMP/batch" "$TMP/lanes"
+        "$MAIN" --batch "$name.batch" --no-simd "$bss" >"$TMP/batch" 2>/dev/null
+        check "$test" "--batch $test.batch --no-simd" "$TMP/batch" "$TMP/lanes"
+    fi
+
+    if [ -f "$name.bad" ]; then
+        while IFS= read -r values || [ -n "$values" ]; do
+            printf '%s\n' "$values" >"$TMP/one"
+            for mode in --input --batch; do
+                if "$MAIN" --run $mode "$TMP/one" "$bss" 2>&1 >/dev/null |
+                    grep -q "not a number"
+                then
+                    passed=$((passed + 1))
+                else
+                    echo "FAIL: $test: $mode accepted '$values'"
+                    failed=$((failed + 1))
+                fi
+            done
+        done <"$name.bad"
+    fi
+done
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "server.h"
+
+/*
+Load generator for the compile daemon.
+
+Each client thread sends the same program over its own persistent
+connection and records per-request latency. --unique appends a distinct
+REM line to every request so the daemon's response cache never hits and
+each request is really compiled. With --oneshot the same load
+is produced by running the one-shot main binary once per request instead,
+which is the baseline the daemon is measured against.
+
+    loadgen [--socket PATH] [--oneshot ./main] [--clients N]
+            [--requests N] [--op tokens|ast|ir] [--unique] file.bss
+*/
+
+typedef struct client {
+    pthread_t thread;
+    const char *socket_path;
+    const char *oneshot;
+    const char *path;
+    const char *src;
+    uint32_t len;
+    uint32_t op;
+    int requests;
+    int unique;
+    int id;
+    double *latency;    // microseconds
+    int failed;
+} client;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int run_oneshot(client *c)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        // main has no token dump; tokens and ast both print the ast
+        if (c->op == TB_OP_IR)
+            execl(c->oneshot, c->oneshot, "--ir", "-O", c->path, (char *)NULL);
+        else
+            execl(c->oneshot, c->oneshot, c->path, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) != 127 ? 0 : -1;
+}
+
+static void *client_main(void *arg)
+{
+    client *c = arg;
+    int fd = -1;
+
+    if (!c->oneshot && (fd = tb_connect(c->socket_path)) < 0) {
+        c->failed = c->requests;
+        return NULL;
+    }
+
+    char *src = malloc(c->len + 64);
+    memcpy(src, c->src, c->len);
+
+    for (int i = 0; i < c->requests; i++) {
+        double start = now_us();
+        int rc;
+
+        if (c->oneshot) {
+            rc = run_oneshot(c);
+        } else {
+            uint32_t status, len, srclen = c->len;
+            if (c->unique)
+                srclen += sprintf(src + c->len, "\n65000 REM %d-%d\n", c->id, i);
+            rc = tb_request(fd, c->op, src, srclen, &status, NULL, &len);
+            if (rc == 0 && status == TB_STATUS_BAD_REQUEST)
+                rc = -1;
+        }
+
+        c->latency[i] = now_us() - start;
+        if (rc < 0)
+            c->failed++;
+    }
+
+    if (fd >= 0)
+        close(fd);
+    free(src);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *label, client *proto, int nclients)
+{
+    client *clients = calloc(nclients, sizeof(client));
+    int total = nclients * proto->requests;
+    double *all = malloc(total * sizeof(double));
+    int failed = 0;
+
+    double start = now_us();
+    for (int i = 0; i < nclients; i++) {
+        clients[i] = *proto;
+        clients[i].id = i;
+        clients[i].latency = all + i * proto->requests;
+        pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+    }
+    for (int i = 0; i < nclients; i++) {
+        pthread_join(clients[i].thread, NULL);
+        failed += clients[i].failed;
+    }
+    double elapsed = now_us() - start;
+
+    qsort(all, total, sizeof(double), compare_double);
+    printf("%-8s %8d %9d %12.0f %10.1f %10.1f %7d\n", label, nclients, total,
+           total / (elapsed / 1e6), all[total / 2], all[(int)(total * 0.99)], failed);
+
+    free(all);
+    free(clients);
+}
+
+int main(int argc, char **argv)
+{
+    client proto = { .op = TB_OP_IR, .requests = 1000 };
+    int nclients = 4;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+            proto.socket_path = argv[++i];
+        else if (strcmp(argv[i], "--oneshot") == 0 && i + 1 < argc)
+            proto.oneshot = argv[++i];
+        else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc)
+            nclients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+            proto.requests = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--unique") == 0)
+            proto.unique = 1;
+        else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+            i++;
+            proto.op = strcmp(argv[i], "tokens") == 0 ? TB_OP_TOKENS :
+                       strcmp(argv[i], "ast") == 0 ? TB_OP_AST : TB_OP_IR;
+        }
+        else
+            proto.path = argv[i];
+    }
+
+    if (!proto.path || (!proto.socket_path && !proto.oneshot) ||
+        nclients <= 0 || proto.requests <= 0)
+    {
+        fprintf(stderr, "usage: %s [--socket PATH] [--oneshot ./main] [--clients N] "
+                "[--requests N] [--op tokens|ast|ir] [--unique] file.bss\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(proto.path, "rb");
+    if (!fp) {
+        perror(proto.path);
+        return 1;
+    }
+    static char src[TB_MAX_REQUEST];
+    proto.len = fread(src, 1, sizeof(src), fp);
+    proto.src = src;
+    fclose(fp);
+
+    printf("%-8s %8s %9s %12s %10s %10s %7s\n",
+           "mode", "clients", "requests", "req/s", "p50 us", "p99 us", "failed");
+
+    if (proto.socket_path) {
+        client daemon = proto;
+        daemon.oneshot = NULL;
+        run("daemon", &daemon, nclients);
+    }
+    if (proto.oneshot)
+        run("oneshot", &proto, nclients);
+
+    return 0;
+}